@@ -13,7 +13,9 @@
 
 #include "nwg_classes.h"
 #include "nwg_tools.h"
+#include "alloc_stats.h"
 #include "on_event.h"
+#include "readahead.h"
 #include "bar.h"
 
 std::string wm {""};            // detected or forced window manager name
@@ -43,6 +45,8 @@ int main(int argc, char *argv[]) {
     long int start_ms = tp.tv_sec * 1000 + tp.tv_usec / 1000;
 
     create_pid_file_or_kill_pid("nwgbar");
+    StartupReadahead readahead{ "nwgbar" };
+    AllocStats alloc_stats;
 
     InputParser input(argc, argv);
     if(input.cmdOptionExists("-h")){
@@ -158,15 +162,15 @@ int main(int argc, char *argv[]) {
 
     std::cout << "WM: " << wm << "\n";
 
-    /* turn off borders, enable floating on sway */
-    if (wm == "sway") {
+    Gtk::Main kit(argc, argv);
+
+    /* turn off borders, enable floating on sway, unless shown as a layer surface */
+    if (wm == "sway" && !CommonWindow::layer_shell_supported()) {
         SwaySock sock;
         sock.run("for_window [title=\"~nwgbar*\"] floating enable");
         sock.run("for_window [title=\"~nwgbar*\"] border none");
     }
 
-    Gtk::Main kit(argc, argv);
-
     auto provider = Gtk::CssProvider::create();
     auto display = Gdk::Display::get_default();
     auto screen = display->get_default_screen();
@@ -181,13 +185,18 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
     auto& icon_theme_ref = *icon_theme.get();
+    auto settings = Gtk::Settings::get_for_screen(screen);
+    IconIndex icon_index{ settings->property_gtk_icon_theme_name().get_value(), image_size };
+    std::cout << icon_index.size() << " icons " << (icon_index.cached() ? "loaded" : "indexed") << '\n';
     auto icon_missing = Gdk::Pixbuf::create_from_file(DATA_DIR_STR "/nwgbar/icon-missing.svg");
 
     if (std::filesystem::is_regular_file(css_file)) {
         provider->load_from_path(css_file);
+        StartupReadahead::note(css_file);
         std::cout << "Using " << css_file << '\n';
     } else {
         provider->load_from_path(default_css_file);
+        StartupReadahead::note(default_css_file);
         std::cout << "Using " << default_css_file << '\n';
     }
 
@@ -197,19 +206,22 @@ int main(int argc, char *argv[]) {
 
     window.signal_button_press_event().connect(sigc::ptr_fun(&on_window_clicked));
 
-    /* Detect focused display geometry: {x, y, width, height} */
-    auto geometry = display_geometry(wm, display, window.get_window());
-    std::cout << "Focused display: " << geometry.x << ", " << geometry.y << ", " << geometry.width << ", "
-    << geometry.height << '\n';
-
-    int x = geometry.x;
-    int y = geometry.y;
-    int w = geometry.width;
-    int h = geometry.height;
-
-    if (wm == "sway" || wm == "i3" || wm == "openbox") {
-        window.resize(w, h);
-        window.move(x, y);
+    // the compositor sizes and places a layer surface by itself
+    if (!window.is_layer_surface()) {
+        /* Detect focused display geometry: {x, y, width, height} */
+        auto geometry = display_geometry(wm, display, window.get_window());
+        std::cout << "Focused display: " << geometry.x << ", " << geometry.y << ", " << geometry.width << ", "
+        << geometry.height << '\n';
+
+        int x = geometry.x;
+        int y = geometry.y;
+        int w = geometry.width;
+        int h = geometry.height;
+
+        if (wm == "sway" || wm == "i3" || wm == "openbox") {
+            window.resize(w, h);
+            window.move(x, y);
+        }
     }
 
     Gtk::Box outer_box(Gtk::ORIENTATION_VERTICAL);
@@ -217,7 +229,7 @@ int main(int argc, char *argv[]) {
 
     /* Create buttons */
     for (auto& entry : bar_entries) {
-        Gtk::Image* image = app_image(icon_theme_ref, entry.icon, icon_missing);
+        Gtk::Image* image = app_image(icon_theme_ref, icon_index, entry.icon, icon_missing);
         auto& ab = window.boxes.emplace_back(std::move(entry.name),
                                              std::move(entry.exec),
                                              std::move(entry.icon));
@@ -266,6 +278,7 @@ int main(int argc, char *argv[]) {
 
     gettimeofday(&tp, NULL);
     long int end_ms = tp.tv_sec * 1000 + tp.tv_usec / 1000;
+    AllocStats::phase("run");
 
     std::cout << "Time: " << end_ms - start_ms << "ms\n";
 
@@ -24,7 +24,10 @@ MainWindow::MainWindow(): CommonWindow("~nwgbar", "~nwgbar") {
     // We can not go fullscreen() here:
     // On sway the window would become opaque - we don't wat it
     // On i3 all windows below will be hidden - we don't want it too
-    if (wm != "sway" && wm != "i3") {
+    // A layer surface already covers the output
+    if (is_layer_surface()) {
+        set_decorated(false);
+    } else if (wm != "sway" && wm != "i3") {
         fullscreen();
     } else {
         set_type_hint(Gdk::WINDOW_TYPE_HINT_SPLASHSCREEN);
@@ -0,0 +1,101 @@
+/*
+ * Benchmark helpers for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace bench {
+
+/*
+ * Runs `fn` `repeat` times and returns the best wall time in milliseconds
+ * */
+template <typename F>
+double time_ms(F&& fn, int repeat = 3) {
+    double best = 0;
+    for (int i = 0; i < repeat; i++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (i == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+/*
+ * Prints one result per line as JSON, so that runs can be compared across versions
+ * */
+inline void emit(std::string_view name, std::size_t items, double ms, nlohmann::json extra = nlohmann::json::object()) {
+    extra["benchmark"] = name;
+    extra["items"] = items;
+    extra["ms"] = ms;
+    extra["us_per_item"] = items ? ms * 1000.0 / items : 0.0;
+    std::cout << extra.dump() << std::endl;
+}
+
+/*
+ * Temporary directory removed on destruction
+ * */
+struct TempDir {
+    std::filesystem::path path;
+    TempDir() {
+        std::string tmpl = (std::filesystem::temp_directory_path() / "nwg-bench-XXXXXX").string();
+        if (!mkdtemp(tmpl.data())) {
+            std::cerr << "ERROR: Failed to create temporary directory\n";
+            std::exit(EXIT_FAILURE);
+        }
+        path = tmpl;
+    }
+    TempDir(const TempDir&) = delete;
+    ~TempDir() {
+        std::error_code ec;
+        std::filesystem::remove_all(path, ec);
+    }
+};
+
+/*
+ * Parses the list of sizes from argv, e.g. `100 1000 10000`
+ * */
+inline std::vector<std::size_t> sizes(int argc, char* argv[], std::vector<std::size_t> fallback) {
+    std::vector<std::size_t> result;
+    for (int i = 1; i < argc; i++) {
+        result.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+    return result.empty() ? fallback : result;
+}
+
+// deterministic pseudo-random numbers, results must not depend on the run
+struct Random {
+    std::uint64_t state = 0x2545F4914F6CDD1D;
+    std::uint64_t operator()(std::uint64_t bound) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state % bound;
+    }
+};
+
+inline constexpr std::string_view WORDS[] = {
+    "fire", "office", "term", "image", "music", "video", "mail", "text", "code", "file",
+    "system", "disk", "network", "print", "photo", "fox", "writer", "viewer", "player", "editor",
+    "client", "manager", "monitor", "browser", "settings", "tool", "calc", "draw", "chat", "game"
+};
+inline constexpr std::size_t WORDS_SIZE = std::size(WORDS);
+
+} // namespace bench
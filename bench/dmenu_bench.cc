@@ -0,0 +1,212 @@
+/*
+ * Benchmarks of the non-GUI part of nwgdmenu
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * *
+ * Generates synthetic $PATH directories and stdin lists of various sizes
+ * and times command listing, sorting and search filtering.
+ * usage: dmenu-bench [sizes...], e.g. `dmenu-bench 5000000` for the scaling of filtering with threads
+ * */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fstream>
+
+#include "nwg_tools.h"
+#include "alloc_stats.h"
+#include "dmenu.h"
+#include "bench.h"
+
+// referenced by dmenu_tools.cc
+bool dmenu_run = false;
+
+static constexpr int ROWS = 20;
+static constexpr std::size_t PATH_DIRS = 8;
+// larger sizes only grow the stdin list
+static constexpr std::size_t PATH_MAX_COMMANDS = 200000;
+
+/*
+ * Times filtering `commands` with a few typical search phrases,
+ * and counts the allocations of one filtering
+ * */
+static void bench_filter(std::string_view name,
+                         const CommandList& commands,
+                         const PrefixIndex* index = nullptr,
+                         const TrigramIndex* trigrams = nullptr) {
+    constexpr std::array queries { "f", "fi", "fire", "er 1", "zzz" };
+    for (auto query : queries) {
+        for (auto case_sensitive : { true, false }) {
+            std::size_t found = 0;
+            auto ms = bench::time_ms([&]() {
+                found = filter_commands(commands, query, case_sensitive, ROWS, nullptr, index, trigrams).size();
+            });
+            auto start = AllocStats::counters();
+            filter_commands(commands, query, case_sensitive, ROWS, nullptr, index, trigrams);
+            auto end = AllocStats::counters();
+            bench::emit(name, commands.size(), ms, {
+                { "query", query }, { "case_sensitive", case_sensitive }, { "found", found },
+                { "allocations", end.count - start.count }, { "allocated_bytes", end.bytes - start.bytes }
+            });
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    using bench::WORDS;
+    using bench::WORDS_SIZE;
+    auto sizes = bench::sizes(argc, argv, { 1000, 10000, 100000 });
+    AllocStats::set_counting(true);
+
+    for (auto size : sizes) {
+        bench::TempDir tmp;
+        bench::Random random;
+
+        // $PATH: a few directories of executables, with duplicates and hidden files
+        auto path_size = std::min(size, PATH_MAX_COMMANDS);
+        std::string path_env;
+        for (std::size_t d = 0; d < PATH_DIRS; d++) {
+            auto dir = tmp.path / ("bin" + std::to_string(d));
+            fs::create_directories(dir);
+            for (std::size_t i = d; i < path_size; i += PATH_DIRS) {
+                std::string name{ WORDS[random(WORDS_SIZE)] };
+                name += '-' + std::to_string(i % (path_size / 2 + 1));
+                if (random(50) == 0) {
+                    name.insert(0, ".");
+                }
+                auto file = dir / name;
+                std::ofstream{ file };
+                fs::permissions(file, fs::perms::owner_all);
+            }
+            if (!path_env.empty()) {
+                path_env += ':';
+            }
+            path_env += dir.native();
+        }
+        setenv("PATH", path_env.c_str(), 1);
+        setenv("XDG_CACHE_HOME", (tmp.path / "cache").c_str(), 1);
+
+        std::vector<std::string> names;
+        auto list_ms = bench::time_ms([&]() { names = list_commands(); });
+        bench::emit("list_commands", names.size(), list_ms);
+
+        // the first run lists $PATH and saves the index, the next ones only stat its directories
+        for (auto cached : { false, true }) {
+            std::size_t found = 0;
+            auto load_ms = bench::time_ms([&]() {
+                CommandList commands;
+                load_commands(commands);
+                found = commands.size();
+            }, cached ? 3 : 1);
+            bench::emit("load_commands", found, load_ms, { { "cached", cached } });
+        }
+
+        // a history about to be compacted, as recorded by the menu
+        {
+            fs::create_directories(tmp.path / "cache" / "nwg-dmenu-history");
+            std::ofstream out(tmp.path / "cache" / "nwg-dmenu-history" / "run");
+            for (std::size_t i = 0; i < 255; i++) {
+                out << 1600000000 + i * 3600 << " 1000 " << names[random(names.size())] << '\n';
+            }
+        }
+        CommandList ranked_commands;
+        load_commands(ranked_commands);
+        std::size_t ranked = 0;
+        auto history_ms = bench::time_ms([&]() {
+            History history;
+            history.load("run");
+            history.update(ranked_commands);
+            ranked = history.size();
+        });
+        bench::emit("load_history", ranked_commands.size(), history_ms, { { "ranked", ranked } });
+
+        auto sort_ms = bench::time_ms([&]() {
+            auto copy = names;
+            sort_commands(copy);
+        });
+        bench::emit("sort_commands", names.size(), sort_ms);
+
+        // stdin: file paths with mixed case, as produced by e.g. `find`
+        auto list_file = tmp.path / "list";
+        {
+            std::ofstream out(list_file);
+            for (std::size_t i = 0; i < size; i++) {
+                out << "/usr/share/" << WORDS[random(WORDS_SIZE)] << '/' << WORDS[random(WORDS_SIZE)]
+                    << (random(2) ? "Player " : "Editor ") << i << ".txt\n";
+            }
+        }
+        // as with `nwgdmenu < list`: mapped and indexed
+        std::optional<CommandList> lines;
+        auto read_ms = bench::time_ms([&]() {
+            auto fd = open(list_file.c_str(), O_RDONLY);
+            lines.emplace().map(fd);
+            close(fd);
+        });
+        bench::emit("read_stdin", lines->size(), read_ms, { { "bytes", fs::file_size(list_file) } });
+        // as with `find | nwgdmenu`: read in blocks
+        CommandList piped;
+        auto append_ms = bench::time_ms([&]() {
+            std::ifstream in(list_file);
+            std::string block;
+            for (std::string line; std::getline(in, line);) {
+                block.append(line).push_back('\n');
+                if (block.size() >= 64 * 1024) {
+                    piped.append(block);
+                    block.clear();
+                }
+            }
+            piped.append(block);
+        }, 1);
+        bench::emit("append_stdin", piped.size(), append_ms);
+        auto unique_ms = bench::time_ms([&]() { unique_lines(*lines); });
+        bench::emit("unique_lines", lines->size(), unique_ms);
+        auto sort_lines_ms = bench::time_ms([&]() { sort_lines(*lines); });
+        bench::emit("sort_lines", lines->size(), sort_lines_ms);
+
+        sort_commands(names);
+        CommandList commands;
+        for (auto&& name : names) {
+            commands.push_back(name);
+        }
+        bench_filter("filter_commands", commands);
+        bench_filter("filter_stdin", *lines);
+
+        // a scan split between 1, 2, 4... threads, as before the indices are built
+        auto cpus = std::max(std::thread::hardware_concurrency(), 1u);
+        for (std::size_t threads = 1;; threads = std::min<std::size_t>(threads * 2, cpus)) {
+            ThreadPool pool{ threads - 1 };
+            for (auto query : { "er 1", "zzz" }) {
+                for (auto case_sensitive : { true, false }) {
+                    std::size_t found = 0;
+                    auto ms = bench::time_ms([&]() {
+                        CommandFilter filter{ query, case_sensitive, ROWS };
+                        filter.use_pool(pool);
+                        filter.update(*lines);
+                        found = filter.result().size();
+                    });
+                    bench::emit("filter_stdin_threads", lines->size(), ms, {
+                        { "query", query }, { "case_sensitive", case_sensitive }, { "found", found },
+                        { "threads", threads }
+                    });
+                }
+            }
+            if (threads == cpus) {
+                break;
+            }
+        }
+
+        std::optional<PrefixIndex> index;
+        auto index_ms = bench::time_ms([&]() { index.emplace(*lines); }, 1);
+        bench::emit("prefix_index", lines->size(), index_ms);
+        bench_filter("filter_stdin_indexed", *lines, &*index);
+
+        std::optional<TrigramIndex> trigrams;
+        auto trigrams_ms = bench::time_ms([&]() { trigrams.emplace(*lines); }, 1);
+        bench::emit("trigram_index", lines->size(), trigrams_ms, { { "bytes", trigrams->bytes() } });
+        bench_filter("filter_stdin_trigrams", *lines, &*index, &*trigrams);
+    }
+    return 0;
+}
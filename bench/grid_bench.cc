@@ -0,0 +1,426 @@
+/*
+ * Benchmarks of the non-GUI part of nwggrid
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * *
+ * Generates synthetic XDG application directories of various sizes
+ * and times .desktop parsing, directory scanning and favourites sorting.
+ * Also reports the allocations and RSS taken by the loaded entries, and times
+ * window lookups in a synthetic sway tree.
+ * usage: grid-bench [sizes...]
+ * */
+
+#include <fstream>
+#include <functional>
+#include <unordered_map>
+#include <variant>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "alloc_stats.h"
+#include "json_scan.h"
+#include "grid.h"
+#include "bench.h"
+
+// referenced by grid_tools.cc
+std::string term { "xterm -e" };
+
+static constexpr std::string_view LOCALES[] = {
+    "ar", "bg", "ca", "cs", "da", "de", "el", "es", "et", "fi", "fr", "he", "hu", "id", "it",
+    "ja", "ko", "lt", "nb", "nl", "pl", "pt", "pt_BR", "ro", "ru", "sk", "sv", "tr", "uk", "zh_CN"
+};
+
+/*
+ * Returns VmRSS of the process in KiB
+ * */
+static std::size_t rss_kib() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) {
+            return std::strtoul(line.data() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Runs `load` and reports the allocations it made and the RSS its result occupies
+ * */
+template <typename F>
+static void emit_memory(std::string_view name, std::size_t items, F&& load, nlohmann::json params) {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    auto rss = rss_kib();
+    auto [count, bytes] = AllocStats::counters();
+    auto start = std::chrono::steady_clock::now();
+    {
+        auto result = load();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        auto after = AllocStats::counters();
+        params["allocations"] = after.count - count;
+        params["allocated_bytes"] = after.bytes - bytes;
+        auto rss_after = rss_kib();
+        params["rss_kib"] = rss_after > rss ? rss_after - rss : 0;
+        bench::emit(name, items, elapsed.count(), params);
+    }
+}
+
+template<typename ... Ts> struct visitor : Ts... { using Ts::operator()...; };
+template<typename ... Ts> visitor(Ts...) -> visitor<Ts...>;
+
+// DesktopEntry as of v0.4.3, owning its strings
+struct LegacyEntry {
+    std::string name;
+    std::string exec;
+    std::string icon;
+    std::string comment;
+    std::string mime_type;
+    bool terminal;
+};
+
+/*
+ * desktop_entry as of v0.4.3, a baseline for the current parser
+ * */
+static std::optional<LegacyEntry> desktop_entry_legacy(std::string&& path, const std::string& lang) {
+    using namespace std::literals::string_view_literals;
+
+    LegacyEntry entry;
+    entry.terminal = false;
+
+    std::ifstream file(path);
+    std::string str;
+
+    std::string name_ln {};         // localized: Name[ln]=
+    std::string loc_name = "Name[" + lang + "]=";
+
+    std::string comment_ln {};      // localized: Comment[ln]=
+    std::string loc_comment = "Comment[" + lang + "]=";
+
+    struct nop_t { } nop;
+    struct cut_t { } cut;
+    struct Match {
+        std::string_view           prefix;
+        std::string*               dest;
+        std::variant<nop_t, cut_t> tag;
+    };
+    struct Result {
+        bool   ok;
+        size_t pos;
+    };
+    Match matches[] = {
+        { "Name="sv,     &entry.name,      nop },
+        { loc_name,      &name_ln,         nop },
+        { "Exec="sv,     &entry.exec,      cut },
+        { "Icon="sv,     &entry.icon,      nop },
+        { "Comment="sv,  &entry.comment,   nop },
+        { loc_comment,   &comment_ln,      nop },
+        { "MimeType="sv, &entry.mime_type, nop },
+    };
+
+    // Skip everything not related
+    constexpr auto header = "[Desktop Entry]"sv;
+    while (std::getline(file, str)) {
+        str.resize(header.size());
+        if (str == header) {
+            break;
+        }
+    }
+    // Repeat until the next section
+    constexpr auto nodisplay = "NoDisplay=true"sv;
+    constexpr auto terminal = "Terminal=true"sv;
+    while (std::getline(file, str)) {
+        if (str[0] == '[') { // new section begins, break
+            break;
+        }
+        auto view = std::string_view{str};
+        auto view_len = std::size(view);
+        if (view == nodisplay) {
+            return std::nullopt;
+        }
+        if (view == terminal) {
+            entry.terminal = true;
+        }
+        auto try_strip_prefix = [&view, view_len](auto& prefix) {
+            auto len = std::min(view_len, std::size(prefix));
+            return Result {
+                prefix == view.substr(0, len),
+                len
+            };
+        };
+        for (auto& [prefix, dest, tag] : matches) {
+            if (auto [ok, pos] = try_strip_prefix(prefix); ok) {
+                std::visit(visitor {
+                    [dest=dest, pos=pos, &view](nop_t) { *dest = view.substr(pos); },
+                    [dest=dest, pos=pos, &view](cut_t) {
+                        auto idx = view.find(" %", pos);
+                        if (idx == std::string_view::npos) {
+                            idx = std::size(view);
+                        }
+                        *dest = view.substr(pos, idx - pos);
+                    }
+                },
+                tag);
+                break;
+            }
+        }
+    }
+
+    if (!name_ln.empty()) {
+        entry.name = std::move(name_ln);
+    }
+    if (!comment_ln.empty()) {
+        entry.comment = std::move(comment_ln);
+    }
+    if (entry.name.empty() || entry.exec.empty()) {
+        return std::nullopt;
+    }
+    if (entry.terminal) {
+        entry.exec = term + " " + entry.exec;
+    }
+    return entry;
+}
+
+/*
+ * Writes a .desktop file resembling the ones shipped by real applications:
+ * a random number of translations, some hidden and terminal entries, some actions
+ * */
+static void write_desktop_file(const fs::path& path, std::size_t i, bench::Random& random) {
+    using bench::WORDS;
+    using bench::WORDS_SIZE;
+    std::ofstream out(path);
+    std::string name{ WORDS[random(WORDS_SIZE)] };
+    name += WORDS[random(WORDS_SIZE)];
+    name += ' ' + std::to_string(i);
+    auto translations = random(std::size(LOCALES) + 1);
+    auto translate = [&](std::string_view key, std::string_view value) {
+        out << key << '=' << value << '\n';
+        for (std::size_t l = 0; l < translations; l++) {
+            out << key << '[' << LOCALES[l] << "]=" << value << " (" << LOCALES[l] << ")\n";
+        }
+    };
+    out << "[Desktop Entry]\nVersion=1.0\nType=Application\n";
+    translate("Name", name);
+    translate("GenericName", WORDS[random(WORDS_SIZE)]);
+    translate("Comment", "Synthetic application " + name + " used to benchmark nwggrid");
+    translate("Keywords", std::string{ WORDS[random(WORDS_SIZE)] } + ';' + std::string{ WORDS[random(WORDS_SIZE)] } + ';');
+    out << "Exec=/usr/bin/" << WORDS[random(WORDS_SIZE)] << '-' << i << " %U\n";
+    out << "Icon=" << WORDS[random(WORDS_SIZE)] << '-' << WORDS[random(WORDS_SIZE)] << '\n';
+    out << "Terminal=" << (random(20) == 0 ? "true" : "false") << '\n';
+    if (random(10) == 0) {
+        out << "NoDisplay=true\n";
+    }
+    out << "Categories=Utility;Development;\n";
+    out << "MimeType=text/plain;text/x-c++src;application/x-" << WORDS[random(WORDS_SIZE)] << ";\n";
+    out << "StartupNotify=true\n";
+    if (random(3) == 0) {
+        out << "Actions=new-window;\n\n[Desktop Action new-window]\n";
+        translate("Name", "New Window");
+        out << "Exec=/usr/bin/" << name << " --new-window\n";
+    }
+}
+
+/*
+ * Returns `swaymsg -t get_tree` of a single workspace with `windows` tiled windows,
+ * half of them Wayland and half X11 ones
+ * */
+static std::string sway_tree(std::size_t windows, bench::Random& random) {
+    auto rect = [&random]() {
+        return ns::json{ { "x", random(3840) }, { "y", random(2160) }, { "width", random(3840) }, { "height", random(2160) } };
+    };
+    auto node = [&rect](std::size_t id, std::string_view type, std::string name) {
+        return ns::json{
+            { "id", id }, { "type", type }, { "orientation", "horizontal" }, { "percent", 1.0 },
+            { "urgent", false }, { "marks", ns::json::array() }, { "focused", false }, { "layout", "splith" },
+            { "border", "normal" }, { "current_border_width", 2 }, { "rect", rect() }, { "deco_rect", rect() },
+            { "window_rect", rect() }, { "geometry", rect() }, { "name", std::move(name) },
+            { "nodes", ns::json::array() }, { "floating_nodes", ns::json::array() }, { "focus", ns::json::array() },
+            { "fullscreen_mode", 0 }, { "sticky", false }
+        };
+    };
+    auto workspace = node(3, "workspace", "1");
+    for (std::size_t i = 0; i < windows; i++) {
+        auto window = node(10 + i, "con", "Document " + std::to_string(i) + " - Editor");
+        window["pid"] = 1000 + i;
+        window["visible"] = true;
+        if (i % 2) {
+            window["app_id"] = "app-" + std::to_string(i);
+            window["shell"] = "xdg_shell";
+        } else {
+            window["app_id"] = nullptr;
+            window["shell"] = "xwayland";
+            window["window_properties"] = {
+                { "class", "App-" + std::to_string(i) }, { "instance", "app" }, { "title", window["name"] }
+            };
+        }
+        workspace["nodes"].push_back(std::move(window));
+    }
+    auto output = node(2, "output", "eDP-1");
+    output["nodes"].push_back(std::move(workspace));
+    auto root = node(1, "root", "root");
+    root["nodes"].push_back(std::move(output));
+    return root.dump();
+}
+
+int main(int argc, char* argv[]) {
+    auto sizes = bench::sizes(argc, argv, { 100, 1000, 10000, 50000 });
+    const std::string lang = "de";
+    AllocStats::set_counting(true);
+
+    for (auto size : sizes) {
+        bench::TempDir tmp;
+        auto data_home = tmp.path / "home";
+        auto data_dir = tmp.path / "share";
+        fs::create_directories(data_home / "applications");
+        fs::create_directories(data_dir / "applications");
+
+        bench::Random random;
+        std::vector<std::string> files;
+        std::size_t bytes = 0;
+        for (std::size_t i = 0; i < size; i++) {
+            auto path = data_dir / "applications" / ("app-" + std::to_string(i) + ".desktop");
+            write_desktop_file(path, i, random);
+            bytes += fs::file_size(path);
+            files.emplace_back(path);
+            // user overrides of some system entries
+            if (i % 20 == 0) {
+                write_desktop_file(data_home / "applications" / path.filename(), i, random);
+            }
+        }
+        nlohmann::json params{ { "files", size }, { "bytes", bytes } };
+
+        std::size_t shown = 0;
+        auto parse_ms = bench::time_ms([&]() {
+            shown = 0;
+            for (auto& file : files) {
+                shown += desktop_entry(std::string{ file }, lang).has_value();
+            }
+        });
+        bench::emit("desktop_entry", size, parse_ms, params);
+
+        auto legacy_ms = bench::time_ms([&]() {
+            for (auto& file : files) {
+                desktop_entry_legacy(std::string{ file }, lang);
+            }
+        });
+        bench::emit("desktop_entry_legacy", size, legacy_ms, params);
+
+        setenv("HOME", tmp.path.c_str(), 1);
+        setenv("XDG_DATA_HOME", data_home.c_str(), 1);
+        setenv("XDG_DATA_DIRS", data_dir.c_str(), 1);
+        std::size_t loaded = 0;
+        auto scan_ms = bench::time_ms([&]() {
+            EntryTable table;
+            load_desktop_entries(get_app_dirs(), lang, table);
+            loaded = table.size();
+        });
+        params["shown"] = loaded;
+        bench::emit("scan_app_dirs", size, scan_ms, params);
+#ifdef HAVE_IO_URING
+        auto uring_ms = bench::time_ms([&]() {
+            EntryTable table;
+            load_desktop_entries_uring(get_app_dirs(), lang, table);
+            loaded = table.size();
+        });
+        params["shown"] = loaded;
+        bench::emit("scan_app_dirs_uring", size, uring_ms, params);
+#endif
+
+        /*
+         * Memory of the loaded entries: desktop-id map, entries, execs and the
+         * name and comment copies GridBoxes held before, against EntryTable
+         * */
+        struct LegacyTable {
+            std::unordered_map<std::string, std::optional<std::size_t>> ids;
+            std::vector<LegacyEntry>   entries;
+            std::vector<std::string>   execs;
+            std::vector<Glib::ustring> labels;
+        };
+        emit_memory("entries_memory_legacy", size, [&]() {
+            LegacyTable table;
+            for (auto& dir : get_app_dirs()) {
+                std::error_code ec;
+                for (auto& file : fs::directory_iterator(dir, ec)) {
+                    auto& path = file.path();
+                    if (path.extension() != ".desktop") {
+                        continue;
+                    }
+                    auto [at, inserted] = table.ids.try_emplace(path.filename(), std::nullopt);
+                    if (!inserted) {
+                        continue;
+                    }
+                    if (auto entry = desktop_entry_legacy(path, lang)) {
+                        at->second = table.entries.size();
+                        table.entries.emplace_back(std::move(*entry));
+                    }
+                }
+            }
+            for (auto& entry : table.entries) {
+                table.execs.emplace_back(entry.exec);
+                table.labels.emplace_back(entry.name);
+                table.labels.emplace_back(entry.comment);
+            }
+            return table;
+        }, params);
+        emit_memory("entries_memory", size, [&]() {
+            EntryTable table;
+            load_desktop_entries(get_app_dirs(), lang, table);
+            return table;
+        }, params);
+
+        ns::json cache;
+        for (std::size_t i = 0; i < size; i++) {
+            cache["app-" + std::to_string(i) + ".desktop"] = random(1000);
+        }
+        std::vector<ns::json> caches(3, cache);
+        std::size_t run = 0;
+        auto favs_ms = bench::time_ms([&]() {
+            get_favourites(std::move(caches[run++]), 6);
+        }, caches.size());
+        bench::emit("get_favourites", size, favs_ms);
+
+        /*
+         * A sway tree of `size` windows searched for a window which isn't there,
+         * as a document against the scanner
+         * */
+        auto tree = sway_tree(size, random);
+        nlohmann::json tree_params{ { "bytes", tree.size() } };
+        const std::vector<std::string_view> names{ "not-running" };
+        auto dom_ms = bench::time_ms([&]() {
+            std::function<bool(const ns::json&)> has_window = [&](const ns::json& node) {
+                auto app_id = node.find("app_id");
+                if (app_id != node.end() && app_id->is_string() && *app_id == names[0]) {
+                    return true;
+                }
+                for (auto key : { "nodes", "floating_nodes" }) {
+                    auto children = node.find(key);
+                    if (children == node.end() || !children->is_array()) {
+                        continue;
+                    }
+                    for (const auto& child : *children) {
+                        if (has_window(child)) {
+                            return true;
+                        }
+                    }
+                }
+                return false;
+            };
+            has_window(ns::json::parse(tree));
+        });
+        bench::emit("find_window_dom", size, dom_ms, tree_params);
+        auto before = AllocStats::counters();
+        auto tree_scan_ms = bench::time_ms([&]() {
+            JsonScanner scan{ tree };
+            find_window(scan, names);
+        });
+        tree_params["allocations"] = (AllocStats::counters().count - before.count) / 3;
+        bench::emit("find_window_scan", size, tree_scan_ms, tree_params);
+    }
+    return 0;
+}
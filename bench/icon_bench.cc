@@ -0,0 +1,218 @@
+/*
+ * Benchmarks of icon lookups
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * *
+ * Generates a synthetic icon theme inheriting hicolor and compares resolving
+ * icon names with IconIndex to Gtk::IconTheme lookups.
+ * usage: icon-bench [sizes...]
+ * */
+
+#include <fstream>
+
+#include "nwg_tools.h"
+#include "bench.h"
+
+namespace fs = std::filesystem;
+
+static constexpr int SIZES[] = { 16, 22, 24, 32, 48, 64, 96, 128, 256 };
+static constexpr int LOOKUP_SIZE = 72;
+
+static void put16(std::string& out, std::uint32_t value) {
+    out.push_back(value >> 8 & 0xFF);
+    out.push_back(value & 0xFF);
+}
+
+static void put32(std::string& out, std::uint32_t value) {
+    put16(out, value >> 16);
+    put16(out, value & 0xFFFF);
+}
+
+static void set32(std::string& out, std::size_t at, std::uint32_t value) {
+    std::string bytes;
+    put32(bytes, value);
+    out.replace(at, 4, bytes);
+}
+
+/*
+ * Writes icon-theme.cache as gtk-update-icon-cache does, minus the hashing:
+ * `images` maps icon names to (directory index, flags) pairs
+ * */
+static void write_icon_cache(const fs::path& root, const std::vector<std::string>& dirs,
+                             const std::vector<std::pair<std::string, std::vector<std::pair<int, int>>>>& images) {
+    constexpr std::uint32_t BUCKETS = 251;
+    std::string out;
+    put16(out, 1);
+    put16(out, 0);
+    put32(out, 0); // hash offset
+    put32(out, 0); // directory list offset
+
+    std::vector<std::uint32_t> dir_names;
+    for (auto& dir : dirs) {
+        dir_names.push_back(out.size());
+        out.append(dir).push_back('\0');
+    }
+    while (out.size() % 4) {
+        out.push_back('\0');
+    }
+    set32(out, 8, out.size());
+    put32(out, dirs.size());
+    for (auto name : dir_names) {
+        put32(out, name);
+    }
+
+    set32(out, 4, out.size());
+    auto buckets = out.size() + 4;
+    put32(out, BUCKETS);
+    for (std::uint32_t b = 0; b < BUCKETS; b++) {
+        put32(out, 0xFFFFFFFF);
+    }
+    for (std::size_t i = 0; i < images.size(); i++) {
+        auto& [name, list] = images[i];
+        auto bucket = buckets + i % BUCKETS * 4;
+        auto icon = out.size();
+        // prepend to the bucket chain
+        put32(out, (std::uint32_t{ static_cast<unsigned char>(out[bucket]) } << 24) |
+                   static_cast<unsigned char>(out[bucket + 1]) << 16 |
+                   static_cast<unsigned char>(out[bucket + 2]) << 8 |
+                   static_cast<unsigned char>(out[bucket + 3]));
+        put32(out, icon + 12);
+        put32(out, 0); // image list offset
+        set32(out, bucket, icon);
+        out.append(name).push_back('\0');
+        while (out.size() % 4) {
+            out.push_back('\0');
+        }
+        set32(out, icon + 8, out.size());
+        put32(out, list.size());
+        for (auto [dir, flags] : list) {
+            put16(out, dir);
+            put16(out, flags);
+            put32(out, 0);
+        }
+    }
+    std::ofstream{ root / "icon-theme.cache", std::ios::binary } << out;
+}
+
+/*
+ * Creates `name` in `base` with fixed size directories and a scalable one;
+ * each icon gets a few random sizes, half of them an SVG too
+ * */
+static std::vector<std::string> write_theme(const fs::path& base, const std::string& name, const std::string& inherits,
+                                            std::size_t count, bench::Random& random, bool cache) {
+    auto root = base / name;
+    std::vector<std::string> dirs;
+    for (auto size : SIZES) {
+        dirs.push_back(std::to_string(size) + 'x' + std::to_string(size) + "/apps");
+    }
+    dirs.emplace_back("scalable/apps");
+    for (auto& dir : dirs) {
+        fs::create_directories(root / dir);
+    }
+    std::ofstream index(root / "index.theme");
+    index << "[Icon Theme]\nName=" << name << "\nInherits=" << inherits << "\nDirectories=";
+    for (auto& dir : dirs) {
+        index << dir << ',';
+    }
+    index << "\n\n";
+    for (std::size_t d = 0; d < std::size(SIZES); d++) {
+        index << '[' << dirs[d] << "]\nSize=" << SIZES[d] << "\nType=Fixed\nContext=Applications\n\n";
+    }
+    index << "[scalable/apps]\nSize=128\nMinSize=16\nMaxSize=512\nType=Scalable\nContext=Applications\n";
+    index.close();
+
+    std::vector<std::pair<std::string, std::vector<std::pair<int, int>>>> images;
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < count; i++) {
+        auto& icon = names.emplace_back(bench::WORDS[random(bench::WORDS_SIZE)]);
+        icon += '-' + name + '-' + std::to_string(i);
+        auto& [_, list] = images.emplace_back(icon, std::vector<std::pair<int, int>>{});
+        for (std::size_t d = 0; d < std::size(SIZES); d++) {
+            if (random(3) == 0) {
+                std::ofstream{ root / dirs[d] / (icon + ".png") };
+                list.emplace_back(d, 4);
+            }
+        }
+        if (list.empty() || random(2) == 0) {
+            std::ofstream{ root / dirs.back() / (icon + ".svg") };
+            list.emplace_back(dirs.size() - 1, 2);
+        }
+    }
+    if (cache) {
+        write_icon_cache(root, dirs, images);
+    }
+    return names;
+}
+
+int main(int argc, char* argv[]) {
+    auto sizes = bench::sizes(argc, argv, { 500, 5000 });
+    Gtk::Main::init_gtkmm_internals();
+
+    for (auto size : sizes) {
+        for (auto cache : { false, true }) {
+            bench::TempDir tmp;
+            bench::Random random;
+            auto base = tmp.path / "share" / "icons";
+            fs::create_directories(base);
+            fs::create_directories(tmp.path / "cache");
+            setenv("HOME", tmp.path.c_str(), 1);
+            setenv("XDG_DATA_HOME", (tmp.path / "share").c_str(), 1);
+            setenv("XDG_DATA_DIRS", (tmp.path / "empty").c_str(), 1);
+            setenv("XDG_CACHE_HOME", (tmp.path / "cache").c_str(), 1);
+
+            auto names = write_theme(base, "Synthetic", "hicolor", size, random, cache);
+            auto fallbacks = write_theme(base, "hicolor", "", size / 4, random, cache);
+            names.insert(names.end(), fallbacks.begin(), fallbacks.end());
+            names.emplace_back("missing-icon");
+            nlohmann::json params{ { "icon_theme_cache", cache } };
+
+            std::size_t indexed = 0;
+            auto build_ms = bench::time_ms([&]() {
+                indexed = IconIndex::build_only("Synthetic", LOOKUP_SIZE).size();
+            });
+            params["indexed"] = indexed;
+            bench::emit("icon_index_build", names.size(), build_ms, params);
+
+            // the first construction builds and saves the index, the following ones load it
+            { IconIndex index{ "Synthetic", LOOKUP_SIZE }; }
+            auto load_ms = bench::time_ms([&]() {
+                IconIndex index{ "Synthetic", LOOKUP_SIZE };
+                indexed = index.cached();
+            });
+            params["loaded"] = indexed != 0;
+            bench::emit("icon_index_load", names.size(), load_ms, params);
+
+            IconIndex index{ "Synthetic", LOOKUP_SIZE };
+            // once, GtkIconTheme caches the results
+            std::size_t found = 0;
+            auto index_ms = bench::time_ms([&]() {
+                for (auto& name : names) {
+                    found += !index.lookup(name).empty();
+                }
+            }, 1);
+            params["found"] = found;
+            bench::emit("icon_index_lookup", names.size(), index_ms, params);
+
+            auto theme = Gtk::IconTheme::create();
+            theme->set_search_path({ base.string() });
+            theme->set_custom_theme("Synthetic");
+            std::size_t agree = 0;
+            found = 0;
+            auto gtk_ms = bench::time_ms([&]() {
+                for (auto& name : names) {
+                    if (auto info = theme->lookup_icon(name, LOOKUP_SIZE, Gtk::ICON_LOOKUP_FORCE_SIZE)) {
+                        found++;
+                        agree += info.get_filename() == index.lookup(name);
+                    }
+                }
+            }, 1);
+            params["found"] = found;
+            params["agree"] = agree;
+            bench::emit("icon_theme_lookup", names.size(), gtk_ms, params);
+        }
+    }
+    return 0;
+}
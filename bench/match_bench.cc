@@ -0,0 +1,81 @@
+/*
+ * Benchmarks of the substring search kernels
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * *
+ * Generates names and commands of mixed case and searches them for a few phrases ignoring case
+ * with each kernel the CPU supports, and with Glib::ustring as before; the exact search with
+ * std::string::find and Glib::ustring::find is timed for reference.
+ * usage: match-bench [sizes...]
+ * */
+
+#include <array>
+
+#include <glibmm/ustring.h>
+
+#include "text_match.h"
+#include "bench.h"
+
+int main(int argc, char* argv[]) {
+    using bench::WORDS;
+    using bench::WORDS_SIZE;
+    auto sizes = bench::sizes(argc, argv, { 1000, 100000 });
+    constexpr std::array queries { "f", "fi", "fire", "player 1", "zzz" };
+    int status = EXIT_SUCCESS;
+
+    for (auto size : sizes) {
+        bench::Random random;
+        // like the names of applications, and the command lines of nwgdmenu
+        std::vector<std::string> texts;
+        for (std::size_t i = 0; i < size; i++) {
+            std::string text;
+            for (auto words = 1 + random(4); words > 0; words--) {
+                std::string word{ WORDS[random(WORDS_SIZE)] };
+                if (random(3) == 0) {
+                    word[0] = word[0] - 'a' + 'A';
+                }
+                text += word;
+                text += random(2) ? " " : "-";
+            }
+            text += std::to_string(i);
+            texts.push_back(std::move(text));
+        }
+        std::vector<Glib::ustring> utexts(texts.begin(), texts.end());
+
+        for (auto query : queries) {
+            std::string_view phrase{ query };
+            Glib::ustring uphrase{ query };
+            auto upper = uphrase.uppercase();
+            auto run = [&](std::string_view name, auto&& find) {
+                std::size_t found = 0;
+                auto ms = bench::time_ms([&]() {
+                    found = 0;
+                    for (std::size_t i = 0; i < size; i++) {
+                        found += find(i) != std::string::npos;
+                    }
+                });
+                bench::emit(name, size, ms, { { "query", query }, { "found", found } });
+                return found;
+            };
+            // the numbers of matches, which the ways of searching must agree on
+            auto exact = run("std_string_find", [&](auto i) { return texts[i].find(phrase); });
+            auto mismatch = run("ustring_find", [&](auto i) { return utexts[i].find(uphrase); }) != exact;
+            auto folded = run("ustring_uppercase_find", [&](auto i) { return utexts[i].uppercase().find(upper); });
+            for (auto kernel : { "scalar", "sse2", "avx2" }) {
+                if (!set_match_kernel(kernel)) {
+                    continue;
+                }
+                auto name = std::string{ "find_ascii_nocase_" } + kernel;
+                mismatch |= run(name, [&](auto i) { return find_ascii_nocase(texts[i], phrase); }) != folded;
+            }
+            if (mismatch) {
+                std::cerr << "ERROR: The kernels disagree on the matches of '" << query << "'\n";
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+    return status;
+}
@@ -0,0 +1,88 @@
+#!/bin/sh
+# Replays a keystroke script against nwggrid or nwgdmenu on a headless
+# broadway display and prints the latency statistics.
+# With REPLAY_GEOMETRY=<width>x<height> it runs on an Xvfb screen of that size
+# instead, REPLAY_ARGS are passed to the launcher.
+#
+# usage: replay.sh grid|dmenu <executable> <script> [entries]
+
+set -eu
+
+mode=$1
+exe=$2
+script=$(realpath "$3")
+entries=${4:-2000}
+
+geometry=${REPLAY_GEOMETRY:-}
+args=${REPLAY_ARGS:-}
+server=broadwayd
+[ -n "$geometry" ] && server=Xvfb
+if ! command -v "$server" > /dev/null 2>&1; then
+	echo "$server not found, skipping"
+	exit 77
+fi
+
+tmp=$(mktemp -d)
+server_pid=
+cleanup() {
+	[ -n "$server_pid" ] && kill "$server_pid" 2> /dev/null
+	rm -rf "$tmp"
+}
+trap cleanup EXIT
+
+# keep the user's config, caches and running instances out of the way
+export HOME="$tmp" XDG_CONFIG_HOME="$tmp/config" XDG_CACHE_HOME="$tmp/cache" XDG_RUNTIME_DIR="$tmp/run"
+unset SWAYSOCK I3SOCK DESKTOP_SESSION WAYLAND_DISPLAY DISPLAY
+mkdir -p "$XDG_CONFIG_HOME" "$XDG_CACHE_HOME" "$XDG_RUNTIME_DIR"
+chmod 700 "$XDG_RUNTIME_DIR"
+
+# synthetic application names, so that queries have realistic hit rates
+names() {
+	awk -v n="$entries" 'BEGIN {
+		split("fire office term image music video mail text code file system disk network print photo", a, " ")
+		split("fox writer inal viewer player editor client manager monitor browser settings tool", b, " ")
+		for (i = 0; i < n; i++) {
+			printf "%s%s %d\n", a[i % 15 + 1], b[int(i / 15) % 12 + 1], i
+		}
+	}'
+}
+
+display=":$(( $$ % 500 + 100 ))"
+if [ -n "$geometry" ]; then
+	Xvfb "$display" -screen 0 "${geometry}x24" +extension Composite > /dev/null 2>&1 &
+	server_pid=$!
+	sleep 1
+	export GDK_BACKEND=x11 DISPLAY="$display"
+else
+	broadwayd "$display" > /dev/null 2>&1 &
+	server_pid=$!
+	sleep 1
+	export GDK_BACKEND=broadway BROADWAY_DISPLAY="$display"
+fi
+
+export NWG_REPLAY="$script" NWG_LATENCY_STATS="$tmp/stats"
+case "$mode" in
+	grid)
+		apps="$tmp/applications"
+		mkdir -p "$apps"
+		names | awk -v dir="$apps" '{
+			f = sprintf("%s/app%05d.desktop", dir, NR)
+			printf "[Desktop Entry]\nType=Application\nName=%s\nName[de]=%s (de)\n", $0, $0 > f
+			printf "Comment=Synthetic entry number %d\nExec=true %%U\nIcon=application-x-executable\n", NR > f
+			if (NR % 10 == 0) print "NoDisplay=true" > f
+			close(f)
+		}'
+		# shellcheck disable=SC2086
+		timeout 120 "$exe" -d "$apps" $args > /dev/null
+		;;
+	dmenu)
+		# shellcheck disable=SC2086
+		names | timeout 120 "$exe" $args > /dev/null
+		;;
+	*)
+		echo "unknown mode: $mode"
+		exit 1
+		;;
+esac
+
+cat "$tmp/stats"
@@ -0,0 +1,257 @@
+/*
+ * Allocation accounting for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include <sys/resource.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "nwgconfig.h"
+#include "alloc_stats.h"
+
+#ifdef HAVE_ALLOC_STATS
+static std::atomic<bool>        counting{ false };
+static std::atomic<std::size_t> alloc_count{ 0 };
+static std::atomic<std::size_t> alloc_bytes{ 0 };
+
+static inline void count_allocation(std::size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        alloc_count.fetch_add(1, std::memory_order_relaxed);
+        alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+#ifdef __GLIBC__
+/*
+ * glibc exports its allocator under these names, so the hook can forward
+ * to it; operator new and g_malloc both end up here
+ * */
+extern "C" {
+void* __libc_malloc(std::size_t);
+void* __libc_calloc(std::size_t, std::size_t);
+void* __libc_realloc(void*, std::size_t);
+void* __libc_memalign(std::size_t, std::size_t);
+
+void* malloc(std::size_t size) noexcept {
+    count_allocation(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(std::size_t n, std::size_t size) noexcept {
+    count_allocation(n * size);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, std::size_t size) noexcept {
+    count_allocation(size);
+    return __libc_realloc(p, size);
+}
+
+void* memalign(std::size_t alignment, std::size_t size) noexcept {
+    count_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size) noexcept {
+    count_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** p, std::size_t alignment, std::size_t size) noexcept {
+    if (alignment % sizeof(void*) || (alignment & (alignment - 1))) {
+        return EINVAL;
+    }
+    count_allocation(size);
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+}
+#else
+void* operator new(std::size_t size) {
+    count_allocation(size);
+    if (auto p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+// bytes in use by the allocator, 0 if unknown
+static long long heap_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    auto info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+// peak resident set size in KiB
+static long peak_rss_kib() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+struct Phase {
+    const char*          name;
+    AllocStats::Counters counters;  // at the start, then allocated during the phase
+    long long            heap;      // at the start, then the change during the phase
+    long                 peak_rss;  // at the end
+};
+
+static Phase              current;
+static std::vector<Phase> phases;
+static std::vector<AllocStats::Counters> filters;
+
+AllocStats::AllocStats() {
+    if (auto env = getenv("NWG_ALLOC_STATS")) {
+        output = env;
+        // keep the bookkeeping out of the counts as far as possible
+        phases.reserve(16);
+        filters.reserve(256);
+        current = { "init", counters(), heap_in_use(), 0 };
+        set_counting(true);
+    }
+}
+
+AllocStats::~AllocStats() {
+    if (!output.empty()) {
+        phase(nullptr);
+        set_counting(false);
+        report();
+    }
+}
+
+void AllocStats::phase(const char* name) {
+    if (!counting.load(std::memory_order_relaxed)) {
+        return;
+    }
+    auto [count, bytes] = counters();
+    auto heap = heap_in_use();
+    current.counters = { count - current.counters.count, bytes - current.counters.bytes };
+    current.heap = heap - current.heap;
+    current.peak_rss = peak_rss_kib();
+    phases.push_back(current);
+    current = { name, { count, bytes }, heap, 0 };
+}
+
+void AllocStats::record_filter(const Counters& start) {
+    if (!counting.load(std::memory_order_relaxed)) {
+        return;
+    }
+    auto [count, bytes] = counters();
+    filters.push_back({ count - start.count, bytes - start.bytes });
+}
+
+AllocStats::Counters AllocStats::counters() {
+    return {
+        alloc_count.load(std::memory_order_relaxed),
+        alloc_bytes.load(std::memory_order_relaxed)
+    };
+}
+
+void AllocStats::set_counting(bool on) {
+    counting.store(on, std::memory_order_relaxed);
+}
+
+/*
+ * Writes allocations, allocated bytes, heap growth and peak RSS per phase,
+ * and the mean and max allocations per filtering
+ * */
+void AllocStats::report() const {
+    std::ofstream file;
+    std::ostream* out = &std::cerr;
+    if (output != "-") {
+        file.open(output, std::ios::trunc);
+        if (!file) {
+            std::cerr << "ERROR: Failed to open " << output << '\n';
+            return;
+        }
+        out = &file;
+    }
+    *out << std::left << std::setw(10) << "phase" << std::right
+         << std::setw(12) << "allocs"
+         << std::setw(14) << "bytes"
+         << std::setw(12) << "heap_kib"
+         << std::setw(14) << "peak_rss_kib" << '\n';
+    Counters total{ 0, 0 };
+    long long total_heap = 0;
+    for (auto& [name, counters, heap, peak_rss] : phases) {
+        *out << std::left << std::setw(10) << name << std::right
+             << std::setw(12) << counters.count
+             << std::setw(14) << counters.bytes
+             << std::setw(12) << heap / 1024
+             << std::setw(14) << peak_rss << '\n';
+        total.count += counters.count;
+        total.bytes += counters.bytes;
+        total_heap += heap;
+    }
+    *out << std::left << std::setw(10) << "total" << std::right
+         << std::setw(12) << total.count
+         << std::setw(14) << total.bytes
+         << std::setw(12) << total_heap / 1024
+         << std::setw(14) << peak_rss_kib() << '\n';
+
+    *out << "filter: n=" << filters.size();
+    if (!filters.empty()) {
+        Counters sum{ 0, 0 };
+        Counters max{ 0, 0 };
+        for (auto [count, bytes] : filters) {
+            sum.count += count;
+            sum.bytes += bytes;
+            max.count = std::max(max.count, count);
+            max.bytes = std::max(max.bytes, bytes);
+        }
+        *out << " allocs_mean=" << sum.count / filters.size()
+             << " allocs_max=" << max.count
+             << " bytes_mean=" << sum.bytes / filters.size()
+             << " bytes_max=" << max.bytes;
+    }
+    *out << '\n';
+}
+#else
+// built without the hook, NWG_ALLOC_STATS only says so
+AllocStats::AllocStats() {
+    if (getenv("NWG_ALLOC_STATS")) {
+        std::cerr << "WARNING: NWG_ALLOC_STATS needs a build with -Dalloc_stats=true\n";
+    }
+}
+
+AllocStats::~AllocStats() { }
+
+void AllocStats::phase(const char*) { }
+
+void AllocStats::record_filter(const Counters&) { }
+
+AllocStats::Counters AllocStats::counters() {
+    return { 0, 0 };
+}
+
+void AllocStats::set_counting(bool) { }
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Allocation accounting for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Counts heap allocations per startup phase and per search filtering.
+ *
+ * In builds with -Dalloc_stats=true every malloc and memalign (with glibc,
+ * which also covers operator new, GLib and Gtk) or operator new (elsewhere)
+ * goes through a counting hook, which only counts while enabled; other builds
+ * count nothing. Disabled unless NWG_ALLOC_STATS is set to a file path, or to "-"
+ * for stderr; a phase ends when the next one begins, and the report is written
+ * when the object is destroyed.
+ * */
+class AllocStats {
+    public:
+        struct Counters {
+            std::size_t count;
+            std::size_t bytes;
+        };
+
+        AllocStats();
+        AllocStats(const AllocStats&) = delete;
+        ~AllocStats();
+
+        // ends the current phase and starts `name`, a string literal
+        static void phase(const char* name);
+        // records a filtering which started when the counters were `start`
+        static void record_filter(const Counters& start);
+        // allocations made so far while counting
+        static Counters counters();
+        // turns the hook on or off, for benchmarks
+        static void set_counting(bool on);
+    private:
+        std::string output;  // file path or "-"
+
+        void report() const;
+};
@@ -0,0 +1,539 @@
+/*
+ * Icon theme index for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <deque>
+#include <string_view>
+#include <unordered_set>
+
+#include "nwg_tools.h"
+#include "icon_index.h"
+
+namespace fs = std::filesystem;
+
+// lower index wins at equal size distance
+static constexpr std::string_view EXTENSIONS[] = { ".png", ".xpm", ".svg" };
+static constexpr int EXTENSIONS_SIZE = std::size(EXTENSIONS);
+
+enum class DirType { Fixed, Scalable, Threshold };
+
+// [subdir] section of index.theme
+struct ThemeDir {
+    DirType type = DirType::Threshold;
+    int     size = 0;
+    int     min_size = -1;
+    int     max_size = -1;
+    int     threshold = 2;
+    int     scale = 1;
+    int     order = 0;  // position in Directories, the first one wins at equal score
+};
+
+struct Theme {
+    std::vector<std::string>                  roots;    // <base dir>/<name> in base dirs order
+    std::vector<std::string>                  inherits;
+    std::unordered_map<std::string, ThemeDir> dirs;     // only the ones listed in Directories
+};
+
+static std::int64_t mtime_ns(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return 0;
+    }
+    return std::int64_t{ st.st_mtim.tv_sec } * 1'000'000'000 + st.st_mtim.tv_nsec;
+}
+
+static std::string_view trim(std::string_view str) {
+    constexpr std::string_view ws = " \t\r";
+    auto start = str.find_first_not_of(ws);
+    if (start == str.npos) {
+        return {};
+    }
+    return str.substr(start, str.find_last_not_of(ws) - start + 1);
+}
+
+static int to_int(std::string_view str) {
+    int value = 0;
+    std::from_chars(str.data(), str.data() + str.size(), value);
+    return value;
+}
+
+// index of the extension of `file` in EXTENSIONS, -1 if it is not an image
+static int extension_of(std::string_view file) {
+    if (file.size() < 5) {
+        return -1;
+    }
+    auto ext = file.substr(file.size() - 4);
+    for (int i = 0; i < EXTENSIONS_SIZE; i++) {
+        if (ext == EXTENSIONS[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Returns directories searched for icons, in the order of the Icon Theme Specification
+ * */
+static std::vector<std::string> icon_base_dirs() {
+    std::vector<std::string> result;
+    auto append = [&result](std::string_view dir, std::string_view suffix) {
+        auto& s = result.emplace_back(dir);
+        if (!s.empty() && s.back() != '/') {
+            s.push_back('/');
+        }
+        s.append(suffix);
+    };
+    std::string home;
+    if (auto home_ = getenv("HOME")) {
+        home = home_;
+        append(home, ".icons");
+    }
+    if (auto data_home = getenv("XDG_DATA_HOME")) {
+        append(data_home, "icons");
+    } else if (!home.empty()) {
+        append(home, ".local/share/icons");
+    }
+    const char* data_dirs = getenv("XDG_DATA_DIRS");
+    if (!data_dirs) {
+        data_dirs = "/usr/local/share/:/usr/share/";
+    }
+    for (auto& dir : split_string(data_dirs, ":")) {
+        if (!dir.empty()) {
+            append(dir, "icons");
+        }
+    }
+    result.emplace_back("/usr/share/pixmaps");
+    return result;
+}
+
+/*
+ * Parses index.theme, keeping the directories listed in Directories and ScaledDirectories
+ * */
+static void parse_index_theme(std::string_view contents, Theme& theme) {
+    std::unordered_map<std::string_view, ThemeDir> sections;
+    std::vector<std::string_view> listed;
+    std::string_view section;
+    while (!contents.empty()) {
+        auto eol = contents.find('\n');
+        auto line = trim(contents.substr(0, eol));
+        contents.remove_prefix(eol == contents.npos ? contents.size() : eol + 1);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (line[0] == '[') {
+            section = line.substr(1, line.find(']') - 1);
+            continue;
+        }
+        auto eq = line.find('=');
+        if (eq == line.npos) {
+            continue;
+        }
+        auto key = trim(line.substr(0, eq));
+        auto value = trim(line.substr(eq + 1));
+        if (section == "Icon Theme") {
+            if (key == "Inherits") {
+                for (auto parent : split_string(value, ",")) {
+                    if (!trim(parent).empty()) {
+                        theme.inherits.emplace_back(trim(parent));
+                    }
+                }
+            } else if (key == "Directories" || key == "ScaledDirectories") {
+                for (auto dir : split_string(value, ",")) {
+                    if (!trim(dir).empty()) {
+                        listed.push_back(trim(dir));
+                    }
+                }
+            }
+            continue;
+        }
+        auto& dir = sections[section];
+        if (key == "Size") {
+            dir.size = to_int(value);
+        } else if (key == "MinSize") {
+            dir.min_size = to_int(value);
+        } else if (key == "MaxSize") {
+            dir.max_size = to_int(value);
+        } else if (key == "Threshold") {
+            dir.threshold = to_int(value);
+        } else if (key == "Scale") {
+            dir.scale = to_int(value);
+        } else if (key == "Type") {
+            if (value == "Fixed") {
+                dir.type = DirType::Fixed;
+            } else if (value == "Scalable") {
+                dir.type = DirType::Scalable;
+            }
+        }
+    }
+    for (auto name : listed) {
+        if (auto section = sections.find(name); section != sections.end()) {
+            auto dir = section->second;
+            dir.order = theme.dirs.size();
+            if (dir.min_size < 0) {
+                dir.min_size = dir.size;
+            }
+            if (dir.max_size < 0) {
+                dir.max_size = dir.size;
+            }
+            theme.dirs.emplace(name, dir);
+        }
+    }
+}
+
+/*
+ * DirectorySizeDistance of the Icon Theme Specification
+ * */
+static int size_distance(const ThemeDir& dir, int size) {
+    switch (dir.type) {
+        case DirType::Fixed:
+            return std::abs(dir.size - size);
+        case DirType::Scalable:
+            if (size < dir.min_size) {
+                return dir.min_size - size;
+            }
+            if (size > dir.max_size) {
+                return size - dir.max_size;
+            }
+            return 0;
+        case DirType::Threshold:
+            if (size < dir.size - dir.threshold) {
+                return dir.min_size - size;
+            }
+            if (size > dir.size + dir.threshold) {
+                return size - dir.max_size;
+            }
+            return 0;
+    }
+    return 0;
+}
+
+/*
+ * Calls `fn(name, dir, extension)` for each image listed in `root`/icon-theme.cache,
+ * where `dir` is an index into `dirs`. Returns false if the cache is missing,
+ * older than `newest` (mtime of the root or of its newest subdir) or malformed,
+ * see gtk/gtkiconcache.c for the format.
+ * */
+template <typename F>
+static bool read_icon_cache(const std::string& root, std::int64_t newest, std::vector<std::string_view>& dirs, F&& fn) {
+    auto path = root + "/icon-theme.cache";
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 12 || mtime_ns(path) < newest) {
+        close(fd);
+        return false;
+    }
+    std::size_t size = st.st_size;
+    auto map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    auto data = static_cast<const unsigned char*>(map);
+    auto ok = true;
+    auto u16 = [&](std::size_t off) -> std::uint32_t {
+        if (off + 2 > size) {
+            ok = false;
+            return 0;
+        }
+        return data[off] << 8 | data[off + 1];
+    };
+    auto u32 = [&](std::size_t off) -> std::uint32_t {
+        if (off + 4 > size) {
+            ok = false;
+            return 0;
+        }
+        return std::uint32_t{ data[off] } << 24 | data[off + 1] << 16 | data[off + 2] << 8 | data[off + 3];
+    };
+    auto str = [&](std::size_t off) -> std::string_view {
+        auto end = off < size ? std::memchr(data + off, '\0', size - off) : nullptr;
+        if (!end) {
+            ok = false;
+            return {};
+        }
+        return { reinterpret_cast<const char*>(data + off), static_cast<std::size_t>(static_cast<const unsigned char*>(end) - data - off) };
+    };
+    // image flags, indexed as EXTENSIONS
+    constexpr std::uint32_t FLAGS[] = { 4, 1, 2 };
+
+    ok = u16(0) == 1;
+    auto hash = u32(4);
+    auto dir_list = u32(8);
+    auto dirs_count = u32(dir_list);
+    for (std::uint32_t i = 0; ok && i < dirs_count; i++) {
+        dirs.push_back(str(u32(dir_list + 4 + i * 4)));
+    }
+    auto buckets = u32(hash);
+    auto steps = size / 12; // guards against cycles in malformed files
+    for (std::uint32_t b = 0; ok && b < buckets; b++) {
+        for (auto icon = u32(hash + 4 + b * 4); ok && icon != 0xFFFFFFFF && steps > 0; icon = u32(icon), steps--) {
+            auto name = str(u32(icon + 4));
+            auto images = u32(icon + 8);
+            auto images_count = u32(images);
+            for (std::uint32_t i = 0; ok && i < images_count; i++) {
+                auto dir = u16(images + 4 + i * 8);
+                auto flags = u16(images + 4 + i * 8 + 2);
+                for (int ext = 0; ok && ext < EXTENSIONS_SIZE; ext++) {
+                    if (flags & FLAGS[ext] && dir < dirs.size()) {
+                        fn(name, dir, ext);
+                    }
+                }
+            }
+        }
+    }
+    munmap(map, size);
+    return ok;
+}
+
+/*
+ * Appends `name` and the themes it inherits to `chain`, depth first
+ * */
+static void add_theme(const std::string& name, const std::vector<std::string>& bases,
+                      std::vector<Theme>& chain, std::unordered_set<std::string>& visited) {
+    if (!visited.insert(name).second) {
+        return;
+    }
+    Theme theme;
+    for (auto& base : bases) {
+        auto root = base + '/' + name;
+        struct stat st;
+        if (stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            theme.roots.push_back(std::move(root));
+        }
+    }
+    for (auto& root : theme.roots) {
+        auto index = root + "/index.theme";
+        if (access(index.c_str(), R_OK) == 0) {
+            parse_index_theme(read_file_to_string(index), theme);
+            break;
+        }
+    }
+    if (theme.dirs.empty()) {
+        return;
+    }
+    auto inherits = std::move(theme.inherits);
+    chain.push_back(std::move(theme));
+    for (auto& parent : inherits) {
+        if (parent != "hicolor") {
+            add_theme(parent, bases, chain, visited);
+        }
+    }
+}
+
+void IconIndex::build(const std::string& theme_name, int size) {
+    auto bases = icon_base_dirs();
+    for (auto& base : bases) {
+        stamps.emplace_back(base, mtime_ns(base));
+    }
+    std::vector<Theme> chain;
+    std::unordered_set<std::string> visited;
+    add_theme(theme_name, bases, chain, visited);
+    add_theme("hicolor", bases, chain, visited);
+
+    // the first theme providing an icon wins, within a theme the closest size does
+    struct Candidate {
+        int                score;
+        int                order;
+        const std::string* dir;
+        int                ext;
+        bool operator<(const Candidate& other) const {
+            return score < other.score || (score == other.score && order < other.order);
+        }
+    };
+    std::deque<std::string> dir_paths; // stable addresses
+    for (auto& theme : chain) {
+        std::unordered_map<std::string_view, Candidate> best;
+        std::deque<std::string> names; // keys of `best`, outlive the cache mappings
+        auto offer = [&best, &names](std::string_view name, const ThemeDir& dir, int size, const std::string* path, int ext) {
+            Candidate candidate{ size_distance(dir, size) * EXTENSIONS_SIZE + ext, dir.order, path, ext };
+            if (auto at = best.find(name); at != best.end()) {
+                if (candidate < at->second) {
+                    at->second = candidate;
+                }
+            } else {
+                best.emplace(names.emplace_back(name), candidate);
+            }
+        };
+        std::vector<std::string_view> cache_dirs;
+        for (auto& root : theme.roots) {
+            // icons added to a subdir change only its mtime, GTK also checks each of them
+            auto newest = mtime_ns(root);
+            stamps.emplace_back(root, newest);
+            for (auto& [subdir, theme_dir] : theme.dirs) {
+                auto path = root + '/' + subdir;
+                if (auto mtime = mtime_ns(path)) {
+                    stamps.emplace_back(std::move(path), mtime);
+                    newest = std::max(newest, mtime);
+                }
+            }
+            cache_dirs.clear();
+            std::vector<std::pair<const ThemeDir*, const std::string*>> resolved;
+            auto resolve = [&](std::string_view subdir) -> std::pair<const ThemeDir*, const std::string*> {
+                auto dir = theme.dirs.find(std::string{ subdir });
+                if (dir == theme.dirs.end() || dir->second.scale != 1) {
+                    return { nullptr, nullptr };
+                }
+                return { &dir->second, &dir_paths.emplace_back(root + '/' + dir->first) };
+            };
+            auto cached = read_icon_cache(root, newest, cache_dirs, [&](std::string_view name, std::size_t dir, int ext) {
+                if (resolved.size() < cache_dirs.size()) {
+                    for (auto subdir : cache_dirs) {
+                        resolved.push_back(resolve(subdir));
+                    }
+                }
+                if (auto [theme_dir, path] = resolved[dir]; theme_dir) {
+                    offer(name, *theme_dir, size, path, ext);
+                }
+            });
+            if (cached) {
+                continue;
+            }
+            for (auto& [subdir, theme_dir] : theme.dirs) {
+                if (theme_dir.scale != 1) {
+                    continue;
+                }
+                auto& path = dir_paths.emplace_back(root + '/' + subdir);
+                auto dir = opendir(path.c_str());
+                if (!dir) {
+                    continue;
+                }
+                while (auto dirent = readdir(dir)) {
+                    std::string_view file = dirent->d_name;
+                    if (auto ext = extension_of(file); ext >= 0) {
+                        file.remove_suffix(EXTENSIONS[ext].size());
+                        offer(file, theme_dir, size, &path, ext);
+                    }
+                }
+                closedir(dir);
+            }
+        }
+        for (auto& [name, candidate] : best) {
+            auto [at, inserted] = icons.try_emplace(std::string{ name });
+            if (inserted) {
+                at->second.reserve(candidate.dir->size() + name.size() + 5);
+                at->second.append(*candidate.dir).append(1, '/').append(name).append(EXTENSIONS[candidate.ext]);
+            }
+        }
+    }
+
+    // unthemed icons directly in the base dirs, also found by file name as in `Icon=foo.png`
+    for (auto& base : bases) {
+        auto dir = opendir(base.c_str());
+        if (!dir) {
+            continue;
+        }
+        while (auto dirent = readdir(dir)) {
+            std::string_view file = dirent->d_name;
+            if (auto ext = extension_of(file); ext >= 0 && dirent->d_type != DT_DIR) {
+                auto path = base + '/' + dirent->d_name;
+                icons.try_emplace(std::string{ file.substr(0, file.size() - EXTENSIONS[ext].size()) }, path);
+                icons.try_emplace(std::string{ file }, std::move(path));
+            }
+        }
+        closedir(dir);
+    }
+}
+
+/*
+ * Reads the index saved by `save` if none of the directories changed since
+ * */
+bool IconIndex::load(const fs::path& file) {
+    auto contents = read_file_to_string(file);
+    std::string_view view = contents;
+    auto next_line = [&view]() {
+        auto eol = view.find('\n');
+        auto line = view.substr(0, eol);
+        view.remove_prefix(eol == view.npos ? view.size() : eol + 1);
+        return line;
+    };
+    auto number = [](std::string_view& str) {
+        std::int64_t value = -1;
+        auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+        str.remove_prefix(end - str.data() + (end != str.data() + str.size()));
+        return ec == std::errc() ? value : -1;
+    };
+    if (next_line() != "nwg-icon-index 2") {
+        return false;
+    }
+    auto counts = next_line();
+    auto stamps_count = number(counts);
+    auto icons_count = number(counts);
+    if (stamps_count < 0 || icons_count < 0) {
+        return false;
+    }
+    for (std::int64_t i = 0; i < stamps_count; i++) {
+        auto line = next_line();
+        auto mtime = number(line);
+        if (line.empty() || mtime != mtime_ns(std::string{ line })) {
+            return false;
+        }
+        stamps.emplace_back(line, mtime);
+    }
+    icons.reserve(icons_count);
+    for (std::int64_t i = 0; i < icons_count && !view.empty(); i++) {
+        auto line = next_line();
+        auto tab = line.find('\t');
+        if (tab == line.npos) {
+            return false;
+        }
+        icons.try_emplace(std::string{ line.substr(0, tab) }, line.substr(tab + 1));
+    }
+    return static_cast<std::int64_t>(icons.size()) == icons_count;
+}
+
+void IconIndex::save(const fs::path& file) const {
+    std::string contents = "nwg-icon-index 2\n";
+    contents += std::to_string(stamps.size()) + ' ' + std::to_string(icons.size()) + '\n';
+    for (auto& [dir, mtime] : stamps) {
+        contents += std::to_string(mtime) + ' ' + dir + '\n';
+    }
+    for (auto& [name, path] : icons) {
+        contents.append(name).append(1, '\t').append(path).append(1, '\n');
+    }
+    std::error_code ec;
+    fs::create_directories(file.parent_path(), ec);
+    auto tmp = file;
+    tmp += ".tmp";
+    save_string_to_file(contents, tmp);
+    fs::rename(tmp, file, ec);
+}
+
+IconIndex::IconIndex(const std::string& theme, int size) {
+    auto file = get_cache_home() / "nwg-icon-index" / (theme + '-' + std::to_string(size));
+    if (load(file)) {
+        loaded = true;
+        return;
+    }
+    icons.clear();
+    stamps.clear();
+    build(theme, size);
+    save(file);
+}
+
+IconIndex IconIndex::build_only(const std::string& theme, int size) {
+    IconIndex index;
+    index.build(theme, size);
+    return index;
+}
+
+const std::string& IconIndex::lookup(const std::string& icon) const {
+    static const std::string none;
+    auto at = icons.find(icon);
+    return at != icons.end() ? at->second : none;
+}
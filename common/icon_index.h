@@ -0,0 +1,55 @@
+/*
+ * Icon theme index for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * Maps icon names to the files best matching one size in an icon theme, its inherited
+ * themes, hicolor and the unthemed pixmaps, following the Icon Theme Specification.
+ * Themes are read from icon-theme.cache where it is up to date, from the directories
+ * otherwise. At equal size distance raster images win over SVG.
+ *
+ * The index is saved to `nwg-icon-index/<theme>-<size>` in the cache dir and reused
+ * until the mtime of any directory it was built from changes.
+ * */
+class IconIndex {
+    public:
+        IconIndex(const std::string& theme, int size);
+        IconIndex(const IconIndex&) = delete;
+        IconIndex(IconIndex&&) = default;
+
+        // returns the file of `icon`, empty if no theme provides it
+        const std::string& lookup(const std::string& icon) const;
+        std::size_t size() const { return icons.size(); }
+        // whether the index was read from the cache dir rather than built
+        bool cached() const { return loaded; }
+
+        // builds the index without touching the cache dir, for benchmarks
+        static IconIndex build_only(const std::string& theme, int size);
+    private:
+        IconIndex() = default;
+
+        // directory and its mtime in nanoseconds, 0 if it did not exist
+        using Stamp = std::pair<std::string, std::int64_t>;
+
+        std::unordered_map<std::string, std::string> icons;
+        std::vector<Stamp> stamps;
+        bool loaded = false;
+
+        void build(const std::string& theme, int size);
+        bool load(const std::filesystem::path& file);
+        void save(const std::filesystem::path& file) const;
+};
@@ -0,0 +1,403 @@
+/*
+ * Streaming JSON scanner for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+#include "json_scan.h"
+
+using namespace std::string_view_literals;
+
+static constexpr std::size_t CHUNK_SIZE = 16 * 1024;
+
+JsonScanner::JsonScanner(std::vector<char>& buffer, Source source):
+    pos{ nullptr }, end{ nullptr }, buffer{ buffer }, source{ std::move(source) }
+{
+    if (buffer.size() < CHUNK_SIZE) {
+        buffer.resize(CHUNK_SIZE);
+    }
+    text_.reserve(256);
+}
+
+JsonScanner::JsonScanner(std::string_view text):
+    pos{ text.data() }, end{ text.data() + text.size() }, buffer{ unused }
+{
+    text_.reserve(256);
+}
+
+bool JsonScanner::refill() {
+    if (!source) {
+        return false;
+    }
+    auto size = source(buffer.data(), buffer.size());
+    pos = buffer.data();
+    end = pos + size;
+    return size > 0;
+}
+
+int JsonScanner::peek() {
+    if (pos == end && !refill()) {
+        return -1;
+    }
+    return static_cast<unsigned char>(*pos);
+}
+
+void JsonScanner::skip_space() {
+    for (auto c = peek(); c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ','; c = peek()) {
+        pos++;
+    }
+}
+
+/*
+ * Reads the string after the opening quote to `text_`, returns false if the document ends first
+ * */
+bool JsonScanner::read_string() {
+    text_.clear();
+    while (true) {
+        if (pos == end && !refill()) {
+            return false;
+        }
+        auto stop = std::find_if(pos, end, [](char c) { return c == '"' || c == '\\'; });
+        text_.append(pos, stop);
+        pos = stop;
+        if (pos == end) {
+            continue;
+        }
+        if (*pos++ == '"') {
+            return true;
+        }
+        auto c = peek();
+        if (c < 0) {
+            return false;
+        }
+        pos++;
+        switch (c) {
+            case 'b': text_.push_back('\b'); break;
+            case 'f': text_.push_back('\f'); break;
+            case 'n': text_.push_back('\n'); break;
+            case 'r': text_.push_back('\r'); break;
+            case 't': text_.push_back('\t'); break;
+            case 'u': text_.append("\\u"); break; // the digits are copied as is
+            default:  text_.push_back(c);
+        }
+    }
+}
+
+/*
+ * Skips the string after the opening quote, returns false if the document ends first
+ * */
+bool JsonScanner::skip_string() {
+    while (true) {
+        if (pos == end && !refill()) {
+            return false;
+        }
+        pos = std::find_if(pos, end, [](char c) { return c == '"' || c == '\\'; });
+        if (pos == end) {
+            continue;
+        }
+        if (*pos++ == '"') {
+            return true;
+        }
+        // the escaped character may be in the next chunk
+        if (peek() < 0) {
+            return false;
+        }
+        pos++;
+    }
+}
+
+JsonScanner::Token JsonScanner::next() {
+    skip_space();
+    auto c = peek();
+    switch (c) {
+        case -1:
+            return Token::End;
+        case '{':
+            pos++;
+            return Token::BeginObject;
+        case '}':
+            pos++;
+            return Token::EndObject;
+        case '[':
+            pos++;
+            return Token::BeginArray;
+        case ']':
+            pos++;
+            return Token::EndArray;
+        case '"':
+            pos++;
+            if (!read_string()) {
+                return Token::Error;
+            }
+            skip_space();
+            if (peek() == ':') {
+                pos++;
+                return Token::Key;
+            }
+            return Token::String;
+    }
+    // literal or number
+    text_.clear();
+    for (; c >= 0 && (std::isalnum(c) || c == '-' || c == '+' || c == '.'); c = peek()) {
+        text_.push_back(c);
+        pos++;
+    }
+    if (text_ == "true"sv) {
+        return Token::True;
+    }
+    if (text_ == "false"sv) {
+        return Token::False;
+    }
+    if (text_ == "null"sv) {
+        return Token::Null;
+    }
+    if (!text_.empty() && (text_[0] == '-' || std::isdigit(static_cast<unsigned char>(text_[0])))) {
+        return Token::Number;
+    }
+    return Token::Error;
+}
+
+void JsonScanner::skip() {
+    std::size_t depth = 1;
+    while (true) {
+        if (pos == end && !refill()) {
+            return;
+        }
+        pos = std::find_if(pos, end, [](char c) {
+            return c == '"' || c == '{' || c == '}' || c == '[' || c == ']';
+        });
+        if (pos == end) {
+            continue;
+        }
+        switch (*pos++) {
+            case '"':
+                if (!skip_string()) {
+                    return;
+                }
+                break;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            default:
+                if (--depth == 0) {
+                    return;
+                }
+        }
+    }
+}
+
+void JsonScanner::skip_value() {
+    skip_space();
+    switch (peek()) {
+        case '{':
+        case '[':
+            pos++;
+            skip();
+            break;
+        case '"':
+            pos++;
+            skip_string();
+            break;
+        default:
+            next();
+    }
+}
+
+template <typename T>
+static bool read_number(JsonScanner& scan, T& value) {
+    if (scan.next() != JsonScanner::Token::Number) {
+        return false;
+    }
+    auto text = scan.text();
+    return std::from_chars(text.data(), text.data() + text.size(), value).ec == std::errc();
+}
+
+/*
+ * Reads the object of "rect" after its opening brace
+ * */
+static std::optional<Geometry> read_rect(JsonScanner& scan) {
+    Geometry rect{ 0, 0, 0, 0 };
+    auto token = scan.next();
+    for (; token == JsonScanner::Token::Key; token = scan.next()) {
+        auto key = scan.text();
+        int* field = key == "x"sv ? &rect.x
+                   : key == "y"sv ? &rect.y
+                   : key == "width"sv ? &rect.width
+                   : key == "height"sv ? &rect.height
+                   : nullptr;
+        if (!field) {
+            scan.skip_value();
+        } else if (!read_number(scan, *field)) {
+            return std::nullopt;
+        }
+    }
+    if (token != JsonScanner::Token::EndObject) {
+        return std::nullopt;
+    }
+    return rect;
+}
+
+static bool focused_in_object(JsonScanner& scan, Geometry& geo);
+
+/*
+ * Searches the array after its opening bracket, returns true when found
+ * */
+static bool focused_in_array(JsonScanner& scan, Geometry& geo) {
+    while (true) {
+        switch (scan.next()) {
+            case JsonScanner::Token::BeginObject:
+                if (focused_in_object(scan, geo)) {
+                    return true;
+                }
+                break;
+            case JsonScanner::Token::BeginArray:
+                if (focused_in_array(scan, geo)) {
+                    return true;
+                }
+                break;
+            case JsonScanner::Token::EndArray:
+            case JsonScanner::Token::End:
+            case JsonScanner::Token::Error:
+                return false;
+            default:
+                break;
+        }
+    }
+}
+
+/*
+ * Searches the object after its opening brace, returns true when found
+ * */
+static bool focused_in_object(JsonScanner& scan, Geometry& geo) {
+    bool focused = false;
+    std::optional<Geometry> rect;
+    while (scan.next() == JsonScanner::Token::Key) {
+        auto key = scan.text();
+        if (key == "focused"sv) {
+            focused = scan.next() == JsonScanner::Token::True;
+        } else if (key == "rect"sv) {
+            if (scan.next() != JsonScanner::Token::BeginObject || !(rect = read_rect(scan))) {
+                return false;
+            }
+        } else {
+            switch (scan.next()) {
+                case JsonScanner::Token::BeginObject:
+                    if (focused_in_object(scan, geo)) {
+                        return true;
+                    }
+                    break;
+                case JsonScanner::Token::BeginArray:
+                    if (focused_in_array(scan, geo)) {
+                        return true;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (focused && rect) {
+            geo = *rect;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::optional<Geometry> focused_rect(JsonScanner& scan) {
+    Geometry geo{ 0, 0, 0, 0 };
+    bool found = false;
+    switch (scan.next()) {
+        case JsonScanner::Token::BeginObject:
+            found = focused_in_object(scan, geo);
+            break;
+        case JsonScanner::Token::BeginArray:
+            found = focused_in_array(scan, geo);
+            break;
+        default:
+            break;
+    }
+    if (!found) {
+        return std::nullopt;
+    }
+    return geo;
+}
+
+static bool equal_ignoring_case(std::string_view a, std::string_view b) {
+    auto lower = [](char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; };
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [&lower](char x, char y) {
+        return lower(x) == lower(y);
+    });
+}
+
+static bool matches(std::string_view name, const std::vector<std::string_view>& names) {
+    return std::any_of(names.begin(), names.end(), [name](auto candidate) {
+        return equal_ignoring_case(name, candidate);
+    });
+}
+
+/*
+ * Searches the node after its opening brace; only "nodes" and "floating_nodes"
+ * are descended into, the other values are skipped without scanning their strings
+ * */
+static bool find_in_node(JsonScanner& scan, const std::vector<std::string_view>& names, std::uint64_t& con_id) {
+    std::optional<std::uint64_t> id;
+    bool matched = false;
+    while (scan.next() == JsonScanner::Token::Key) {
+        auto key = scan.text();
+        if (key == "id"sv) {
+            std::uint64_t value;
+            if (!read_number(scan, value)) {
+                return false;
+            }
+            id = value;
+        } else if (key == "app_id"sv) {
+            matched |= scan.next() == JsonScanner::Token::String && matches(scan.text(), names);
+        } else if (key == "window_properties"sv) {
+            if (scan.next() != JsonScanner::Token::BeginObject) {
+                continue;
+            }
+            while (scan.next() == JsonScanner::Token::Key) {
+                if (scan.text() == "class"sv) {
+                    matched |= scan.next() == JsonScanner::Token::String && matches(scan.text(), names);
+                } else {
+                    scan.skip_value();
+                }
+            }
+        } else if (key == "nodes"sv || key == "floating_nodes"sv) {
+            if (scan.next() != JsonScanner::Token::BeginArray) {
+                continue;
+            }
+            for (auto token = scan.next(); token != JsonScanner::Token::EndArray; token = scan.next()) {
+                if (token != JsonScanner::Token::BeginObject) {
+                    return false;
+                }
+                if (find_in_node(scan, names, con_id)) {
+                    return true;
+                }
+            }
+        } else {
+            scan.skip_value();
+        }
+        if (matched && id) {
+            con_id = *id;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::optional<std::uint64_t> find_window(JsonScanner& scan, const std::vector<std::string_view>& names) {
+    std::uint64_t con_id = 0;
+    if (scan.next() != JsonScanner::Token::BeginObject || !find_in_node(scan, names, con_id)) {
+        return std::nullopt;
+    }
+    return con_id;
+}
@@ -0,0 +1,79 @@
+/*
+ * Streaming JSON scanner for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nwg_classes.h"
+
+/*
+ * Pull scanner of a JSON document read in chunks into a caller-owned buffer,
+ * for picking a few values out of large compositor replies without building
+ * the document. Commas are skipped, a string followed by ':' is a Key.
+ * String escapes other than \uXXXX are decoded; numbers are returned as text.
+ * */
+class JsonScanner {
+    public:
+        enum class Token {
+            BeginObject,
+            EndObject,
+            BeginArray,
+            EndArray,
+            Key,
+            String,
+            Number,
+            True,
+            False,
+            Null,
+            End,
+            Error
+        };
+        // reads up to `size` bytes into `data`, returns 0 at the end of the document
+        using Source = std::function<std::size_t(char* data, std::size_t size)>;
+
+        JsonScanner(std::vector<char>& buffer, Source source);
+        // scans the document `text`
+        explicit JsonScanner(std::string_view text);
+        // `buffer` may refer to `unused`
+        JsonScanner(const JsonScanner&) = delete;
+        JsonScanner& operator=(const JsonScanner&) = delete;
+
+        Token next();
+        // text of the last Key, String or Number, valid until the next call
+        std::string_view text() const { return text_; }
+        // skips the rest of the innermost object or array
+        void skip();
+        // skips the value following a Key
+        void skip_value();
+    private:
+        const char*           pos;
+        const char*           end;
+        std::vector<char>     unused;  // buffer of a scanner of a whole document
+        std::vector<char>&    buffer;
+        Source                source;
+        std::string           text_;
+
+        bool refill();
+        int  peek();
+        void skip_space();
+        bool skip_string();
+        bool read_string();
+};
+
+// x, y, width and height of the first object with "focused": true, depth first
+std::optional<Geometry> focused_rect(JsonScanner& scan);
+// con id of the first node of a sway/i3 tree whose app_id or window_properties.class
+// is one of `names`, ignoring ASCII case
+std::optional<std::uint64_t> find_window(JsonScanner& scan, const std::vector<std::string_view>& names);
@@ -0,0 +1,127 @@
+/*
+ * Latency instrumentation for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "latency.h"
+
+// used when the frame clock does not know the refresh rate
+static constexpr gint64 DEFAULT_FRAME_BUDGET = 1000000 / 60;
+
+LatencyProbe::LatencyProbe() {
+    if (auto env = getenv("NWG_LATENCY_STATS")) {
+        output = env;
+    }
+}
+
+LatencyProbe::~LatencyProbe() {
+    for (auto [clock, handler] : clocks) {
+        g_signal_handler_disconnect(clock, handler);
+        g_object_unref(clock);
+    }
+    if (enabled()) {
+        report();
+    }
+}
+
+void LatencyProbe::begin(Kind kind, Gtk::Widget& widget) {
+    if (!enabled()) {
+        return;
+    }
+    // only realized widgets have a frame clock
+    auto clock = gtk_widget_get_frame_clock(widget.gobj());
+    if (!clock) {
+        return;
+    }
+    connect_(clock);
+    pending.push_back({ kind, g_get_monotonic_time(), clock });
+    // make sure a frame follows even if the event did not damage anything
+    gdk_frame_clock_request_phase(clock, GDK_FRAME_CLOCK_PHASE_AFTER_PAINT);
+}
+
+void LatencyProbe::record(Kind kind, gint64 start) {
+    if (!enabled()) {
+        return;
+    }
+    auto& histogram = histograms[kind];
+    auto duration = g_get_monotonic_time() - start;
+    histogram.samples.push_back(duration);
+    histogram.over_budget += duration > DEFAULT_FRAME_BUDGET;
+}
+
+void LatencyProbe::connect_(GdkFrameClock* clock) {
+    auto connected = std::any_of(clocks.begin(), clocks.end(), [clock](auto& c) {
+        return c.first == clock;
+    });
+    if (!connected) {
+        auto handler = g_signal_connect(clock, "after-paint", G_CALLBACK(&LatencyProbe::on_after_paint_), this);
+        clocks.emplace_back(GDK_FRAME_CLOCK(g_object_ref(clock)), handler);
+    }
+}
+
+void LatencyProbe::on_after_paint_(GdkFrameClock* clock, gpointer data) {
+    auto& probe = *static_cast<LatencyProbe*>(data);
+    auto now = g_get_monotonic_time();
+    gint64 budget = 0;
+    gdk_frame_clock_get_refresh_info(clock, now, &budget, nullptr);
+    if (budget <= 0) {
+        budget = DEFAULT_FRAME_BUDGET;
+    }
+    auto& pending = probe.pending;
+    auto resolved = std::remove_if(pending.begin(), pending.end(), [&](auto& p) {
+        if (p.clock != clock) {
+            return false;
+        }
+        auto& histogram = probe.histograms[p.kind];
+        auto latency = now - p.start;
+        histogram.samples.push_back(latency);
+        histogram.over_budget += latency > budget;
+        return true;
+    });
+    pending.erase(resolved, pending.end());
+}
+
+/*
+ * Writes p50/p95/p99 and the number of samples over the frame budget
+ * */
+void LatencyProbe::report() const {
+    constexpr std::array names { "keystroke", "show", "filter", "draw", "focus" };
+    std::ofstream file;
+    std::ostream* out = &std::cerr;
+    if (output != "-") {
+        file.open(output, std::ios::trunc);
+        if (!file) {
+            std::cerr << "ERROR: Failed to open " << output << '\n';
+            return;
+        }
+        out = &file;
+    }
+    *out << std::fixed << std::setprecision(2);
+    for (std::size_t kind = 0; kind < KindsCount; kind++) {
+        auto samples = histograms[kind].samples;
+        *out << names[kind] << ": n=" << samples.size();
+        if (!samples.empty()) {
+            std::sort(samples.begin(), samples.end());
+            // nearest-rank percentile
+            auto percentile = [&samples](auto p) {
+                auto rank = (samples.size() * p + 99) / 100;
+                return samples[std::max<std::size_t>(rank, 1) - 1] / 1000.0;
+            };
+            *out << " p50=" << percentile(50) << "ms"
+                 << " p95=" << percentile(95) << "ms"
+                 << " p99=" << percentile(99) << "ms"
+                 << " max=" << samples.back() / 1000.0 << "ms"
+                 << " over_budget=" << histograms[kind].over_budget;
+        }
+        *out << '\n';
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ * Latency instrumentation for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <gtkmm.h>
+
+/*
+ * Measures the time between an event (key press, window shown)
+ * and the end of the next frame painted by the widget's frame clock,
+ * and the duration of search filtering, of drawing the window and of looking up
+ * a running instance to focus.
+ * Disabled unless NWG_LATENCY_STATS is set to a file path, or to "-" for stderr;
+ * the report is written when the probe is destroyed.
+ * */
+class LatencyProbe {
+    public:
+        enum Kind {
+            Keystroke = 0,
+            Show,
+            Filter,
+            Draw,
+            Focus,
+            KindsCount
+        };
+
+        LatencyProbe();
+        LatencyProbe(const LatencyProbe&) = delete;
+        ~LatencyProbe();
+
+        bool enabled() const { return !output.empty(); }
+        // start measuring, the sample ends at the next after-paint of `widget`'s frame clock
+        void begin(Kind kind, Gtk::Widget& widget);
+        // record a sample started at `start` (g_get_monotonic_time) and ending now
+        void record(Kind kind, gint64 start);
+        void report() const;
+    private:
+        struct Pending {
+            Kind           kind;
+            gint64         start;
+            GdkFrameClock* clock;
+        };
+        struct Histogram {
+            std::vector<gint64> samples;     // microseconds
+            std::size_t         over_budget = 0;
+        };
+        std::string                          output;   // file path or "-"
+        std::array<Histogram, KindsCount>    histograms;
+        std::vector<Pending>                 pending;
+        std::vector<std::pair<GdkFrameClock*, gulong>> clocks; // connected after-paint handlers
+
+        void connect_(GdkFrameClock*);
+        static void on_after_paint_(GdkFrameClock*, gpointer);
+};
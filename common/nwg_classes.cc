@@ -11,11 +11,17 @@
 
 #include <algorithm>
 #include <array>
+#include <cstdlib>
 #include <iostream>
 
+#include "nwgconfig.h"
 #include "nwg_classes.h"
 #include "nwg_tools.h"
 
+#ifdef HAVE_LAYER_SHELL
+#include <gtk-layer-shell.h>
+#endif
+
 InputParser::InputParser (int argc, char **argv) {
     tokens.reserve(argc - 1);
     for (int i = 1; i < argc; ++i) {
@@ -59,14 +65,49 @@ CommonWindow::CommonWindow(const Glib::ustring& title, const Glib::ustring& role
     add_events(Gdk::KEY_PRESS_MASK | Gdk::KEY_RELEASE_MASK);
     set_app_paintable(true);
     check_screen();
+#ifdef HAVE_LAYER_SHELL
+    /*
+     * An overlay covering the output the compositor picks, the focused one,
+     * with the keyboard to itself; mapped in one configure without IPC rules
+     * */
+    if (layer_shell_supported()) {
+        auto window = gobj();
+        gtk_layer_init_for_window(window);
+        auto name = role.raw();
+        gtk_layer_set_namespace(window, name.c_str() + name.find_first_not_of('~'));
+        gtk_layer_set_layer(window, GTK_LAYER_SHELL_LAYER_OVERLAY);
+        gtk_layer_set_keyboard_mode(window, GTK_LAYER_SHELL_KEYBOARD_MODE_EXCLUSIVE);
+        for (auto edge : { GTK_LAYER_SHELL_EDGE_LEFT, GTK_LAYER_SHELL_EDGE_RIGHT,
+                           GTK_LAYER_SHELL_EDGE_TOP, GTK_LAYER_SHELL_EDGE_BOTTOM }) {
+            gtk_layer_set_anchor(window, edge, true);
+        }
+        // cover panels as well
+        gtk_layer_set_exclusive_zone(window, -1);
+        layer_surface = true;
+    }
+#endif
 }
 
 CommonWindow::~CommonWindow() { }
 
+bool CommonWindow::layer_shell_supported() {
+#ifdef HAVE_LAYER_SHELL
+    // NWG_LAYER_SHELL=off keeps the plain window, placed with the compositor IPC as before
+    if (auto env = getenv("NWG_LAYER_SHELL"); env && std::string_view{ env } == "off") {
+        return false;
+    }
+    return gtk_layer_is_supported();
+#else
+    return false;
+#endif
+}
+
 bool CommonWindow::on_draw(const Cairo::RefPtr<Cairo::Context>& cr) {
+    auto start = g_get_monotonic_time();
     cr->save();
     auto [r, g, b, a] = this->background_color;
-    if (_SUPPORTS_ALPHA) {
+    // an opaque background is a plain solid fill, without blending any alpha
+    if (_SUPPORTS_ALPHA && a < 1.0) {
         cr->set_source_rgba(r, g, b, a);
     } else {
         cr->set_source_rgb(r, g, b);
@@ -74,7 +115,15 @@ bool CommonWindow::on_draw(const Cairo::RefPtr<Cairo::Context>& cr) {
     cr->set_operator(Cairo::OPERATOR_SOURCE);
     cr->paint();
     cr->restore();
-    return Gtk::Window::on_draw(cr);
+    auto handled = Gtk::Window::on_draw(cr);
+    latency.record(LatencyProbe::Draw, start);
+    return handled;
+}
+
+void CommonWindow::on_show() {
+    Gtk::Window::on_show();
+    // the window is realized now, measure until its first frame
+    latency.begin(LatencyProbe::Show, *this);
 }
 
 void CommonWindow::on_screen_changed(const Glib::RefPtr<Gdk::Screen>& previous_screen) {
@@ -90,7 +139,8 @@ void CommonWindow::check_screen() {
         std::cerr << "Your screen does not support alpha channels!\n";
     }
     _SUPPORTS_ALPHA = (bool)visual;
-    gtk_widget_set_visual(GTK_WIDGET(gobj()), visual->gobj());
+    // without an RGBA visual keep the default one, the background is painted opaque
+    gtk_widget_set_visual(GTK_WIDGET(gobj()), visual ? visual->gobj() : nullptr);
 }
 
 void CommonWindow::set_background_color(RGBA color) {
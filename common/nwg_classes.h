@@ -12,11 +12,14 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <gtkmm.h>
 #include <glibmm/ustring.h>
 
+#include "latency.h"
+
 struct RGBA {
     double red;
     double green;
@@ -47,12 +50,20 @@ class CommonWindow : public Gtk::Window {
 
         void check_screen();
         void set_background_color(RGBA color);
+        // whether the window is a layer-shell surface, which the compositor sizes and places
+        bool is_layer_surface() const { return layer_surface; }
+        // whether windows become layer-shell surfaces, once the display is open; see NWG_LAYER_SHELL
+        static bool layer_shell_supported();
+
+        LatencyProbe latency;
     protected:
         bool on_draw(const ::Cairo::RefPtr< ::Cairo::Context>& cr) override;
+        void on_show() override;
         void on_screen_changed(const Glib::RefPtr<Gdk::Screen>& previous_screen) override;
     private:
         RGBA background_color;
         bool _SUPPORTS_ALPHA;
+        bool layer_surface = false;
 };
 
 class AppBox : public Gtk::Button {
@@ -79,11 +90,13 @@ struct Geometry {
     int height;
 };
 
+// Views of the values of a .desktop file
 struct DesktopEntry {
-    std::string name;
-    std::string exec;
-    std::string icon;
-    std::string comment;
-    std::string mime_type;
+    std::string_view name;
+    std::string_view exec;
+    std::string_view icon;
+    std::string_view comment;
+    std::string_view mime_type;
+    std::string_view wm_class;
     bool terminal;
 };
@@ -15,13 +15,16 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
 
 #include "nwgconfig.h"
 #include "nwg_tools.h"
+#include "readahead.h"
 
 // extern variables from nwg_tools.h
 int image_size = 72;
@@ -226,39 +229,94 @@ SwaySock::~SwaySock() {
 }
 
 /*
- * Returns `swaymsg -t get_outputs`
+ * Sends `command` and returns a scanner of the reply, which is received in chunks
+ * as it is scanned; `drain_` has to be called before the next command
  * Throws `SwayError`
  * */
-std::string SwaySock::get_outputs() {
-    send_header_(0, Commands::GetOutputs);
-    return recv_response_();
+JsonScanner SwaySock::scan_reply_(Commands command) {
+    send_header_(0, command);
+    recv_header_();
+    return JsonScanner{ buffer, [this](char* data, std::size_t size) {
+        return recv_payload_(data, size);
+    } };
 }
 
 /*
- * Returns output of previously issued command
- * Throws `SwayError::Recv{Header,Body}Failed`
- */
-std::string SwaySock::recv_response_() {
+ * Returns the rect of the focused output, stops reading at the focused one
+ * Throws `SwayError`
+ * */
+std::optional<Geometry> SwaySock::focused_output() {
+    auto scan = scan_reply_(Commands::GetOutputs);
+    auto rect = focused_rect(scan);
+    drain_();
+    return rect;
+}
+
+/*
+ * Returns the rect of the focused workspace, stops reading at the focused one
+ * Throws `SwayError`
+ * */
+std::optional<Geometry> SwaySock::focused_workspace() {
+    auto scan = scan_reply_(Commands::GetWorkspaces);
+    auto rect = focused_rect(scan);
+    drain_();
+    return rect;
+}
+
+/*
+ * Scans `swaymsg -t get_tree` while receiving it, stops reading at the first match
+ * Throws `SwayError`
+ * */
+std::optional<std::uint64_t> SwaySock::find_window(const std::vector<std::string_view>& names) {
+    auto scan = scan_reply_(Commands::GetTree);
+    auto con_id = ::find_window(scan, names);
+    drain_();
+    return con_id;
+}
+
+/*
+ * Reads the reply header of previously issued command
+ * Throws `SwayError::RecvHeaderFailed`
+ * */
+void SwaySock::recv_header_() {
     std::size_t total = 0;
     while (total < HEADER_SIZE) {
-        auto received = recv(sock_, header.data(), HEADER_SIZE - total, 0);
-        if (received < 0) {
+        auto received = recv(sock_, header.data() + total, HEADER_SIZE - total, 0);
+        if (received <= 0) {
             throw SwayError::RecvHeaderFailed;
         }
         total += received;
     }
-    auto payload_size = *reinterpret_cast<std::uint32_t*>(header.data() + MAGIC_SIZE);
-    std::string buffer(payload_size + 1, '\0');
-    auto payload = buffer.data();
-    total = 0;
-    while (total < payload_size) {
-        auto received = recv(sock_, payload + total, payload_size - total, 0);
-        if (received < 0) {
-            throw SwayError::RecvBodyFailed;
-        }
-        total += received;
+    std::uint32_t payload_size;
+    memcpy(&payload_size, header.data() + MAGIC_SIZE, sizeof(payload_size));
+    remaining = payload_size;
+}
+
+/*
+ * Receives at most `size` bytes of the reply payload, 0 when all of it is received
+ * Throws `SwayError::RecvBodyFailed`
+ * */
+std::size_t SwaySock::recv_payload_(char* data, std::size_t size) {
+    if (remaining == 0) {
+        return 0;
+    }
+    auto received = recv(sock_, data, std::min(size, remaining), 0);
+    if (received <= 0) {
+        throw SwayError::RecvBodyFailed;
     }
-    return buffer;   
+    remaining -= received;
+    return received;
+}
+
+/*
+ * Discards the rest of the reply payload
+ * Throws `SwayError::RecvBodyFailed`
+ * */
+void SwaySock::drain_() {
+    if (buffer.empty()) {
+        buffer.resize(16 * 1024);
+    }
+    while (recv_payload_(buffer.data(), buffer.size()) > 0);
 }
 
 /*
@@ -268,9 +326,9 @@ std::string SwaySock::recv_response_() {
 void SwaySock::run(std::string_view cmd) {
     send_header_(cmd.size(), Commands::Run);
     send_body_(cmd);
-    // should we recv the response?
-    // suppress warning
-    (void)recv_response_();
+    // the reply is not needed
+    recv_header_();
+    drain_();
 }
 
 void SwaySock::send_header_(std::uint32_t message_len, Commands command) {
@@ -292,40 +350,26 @@ void SwaySock::send_body_(std::string_view cmd) {
  * */
 Geometry display_geometry(const std::string& wm, Glib::RefPtr<Gdk::Display> display, Glib::RefPtr<Gdk::Window> window) {
     Geometry geo = {0, 0, 0, 0};
-    if (wm == "sway") {
+    if (wm == "sway" || wm == "i3") {
         try {
             SwaySock sock;
-            auto jsonString = sock.get_outputs();
-            auto jsonObj = string_to_json(jsonString);
-            for (auto&& entry : jsonObj) {
-                if (entry.at("focused")) {
-                    auto&& rect = entry.at("rect");
-                    geo.x = rect.at("x");
-                    geo.y = rect.at("y");
-                    geo.width = rect.at("width");
-                    geo.height = rect.at("height");
-                    break;
-                }
+            // sway's workspaces are as big as the outputs, i3's workspaces leave out the bars
+            auto rect = wm == "sway" ? sock.focused_output() : sock.focused_workspace();
+            if (rect) {
+                return *rect;
             }
-            return geo;
         }
         catch (...) { }
-    } else if (wm == "i3") { // TODO: shouldn't sway also work with i3?
-        try {
-            auto jsonString = get_output("i3-msg -t get_workspaces");
-            auto jsonObj = string_to_json(jsonString);
-            for (auto&& entry : jsonObj) {
-                if (entry.at("focused")) {
-                    auto&& rect = entry.at("rect");
-                    geo.x = rect.at("x");
-                    geo.y = rect.at("y");
-                    geo.width = rect.at("width");
-                    geo.height = rect.at("height");
-                    break;
+        if (wm == "i3") {
+            try {
+                auto reply = get_output("i3-msg -t get_workspaces");
+                JsonScanner scan{ reply };
+                if (auto rect = focused_rect(scan)) {
+                    geo = *rect;
                 }
             }
+            catch (...) { }
         }
-        catch (...) { }
     }
 
     // it's going to fail until the window is actually open
@@ -354,23 +398,28 @@ Geometry display_geometry(const std::string& wm, Glib::RefPtr<Gdk::Display> disp
  * */
 Gtk::Image* app_image(
     const Gtk::IconTheme& icon_theme,
+    const IconIndex& icon_index,
     const std::string& icon,
     const Glib::RefPtr<Gdk::Pixbuf>& fallback
 ) {
     Glib::RefPtr<Gdk::Pixbuf> pixbuf;
 
     try {
+        const std::string* file = &icon;
         if (icon.find_first_of("/") == std::string::npos) {
-            pixbuf = icon_theme.load_icon(icon, image_size, Gtk::ICON_LOOKUP_FORCE_SIZE);
-        } else {
-            pixbuf = Gdk::Pixbuf::create_from_file(icon, image_size, image_size, true);
+            file = &icon_index.lookup(icon);
         }
-    } catch (...) {
-        try {
-            pixbuf = Gdk::Pixbuf::create_from_file("/usr/share/pixmaps/" + icon, image_size, image_size, true);
-        } catch (...) {
-            pixbuf = fallback;
+        if (!file->empty()) {
+            pixbuf = Gdk::Pixbuf::create_from_file(*file, image_size, image_size, true);
+            StartupReadahead::note(*file);
+        } else if (auto info = icon_theme.lookup_icon(icon, image_size, Gtk::ICON_LOOKUP_FORCE_SIZE)) {
+            // icons the index does not know, e.g. built into GTK
+            StartupReadahead::note(info.get_filename());
+            pixbuf = info.load_icon();
         }
+    } catch (...) { }
+    if (!pixbuf) {
+        pixbuf = fallback;
     }
     auto image = Gtk::manage(new Gtk::Image(pixbuf));
 
@@ -400,6 +449,7 @@ std::string get_locale() {
  * Returns file content as a string
  * */
 std::string read_file_to_string(const std::filesystem::path& filename) {
+    StartupReadahead::note(filename);
     std::ifstream input(filename);
     std::stringstream sstr;
 
@@ -448,6 +498,7 @@ std::string_view take_last_by(std::string_view str, std::string_view delimiter)
  * Reads json from file
  * */
 ns::json json_from_file(const std::filesystem::path& path) {
+    StartupReadahead::note(path);
     ns::json json;
     std::ifstream{path} >> json;
     return json;
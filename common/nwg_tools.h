@@ -14,6 +14,7 @@
 #include <filesystem>
 #include <iostream>
 #include <iomanip>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -23,6 +24,8 @@
 #include <nlohmann/json.hpp>
 
 #include "nwg_classes.h"
+#include "icon_index.h"
+#include "json_scan.h"
 
 namespace ns = nlohmann;
 
@@ -49,7 +52,7 @@ void decode_color(std::string_view, RGBA& color);
 
 std::string get_output(const std::string&);
 
-Gtk::Image* app_image(const Gtk::IconTheme&, const std::string&, const Glib::RefPtr<Gdk::Pixbuf>&);
+Gtk::Image* app_image(const Gtk::IconTheme&, const IconIndex&, const std::string&, const Glib::RefPtr<Gdk::Pixbuf>&);
 Geometry display_geometry(const std::string&, Glib::RefPtr<Gdk::Display>, Glib::RefPtr<Gdk::Window>);
 
 void create_pid_file_or_kill_pid(std::string);
@@ -70,13 +73,20 @@ struct SwaySock {
     ~SwaySock();
     // pass the command to sway via socket
     void run(std::string_view);
-    // swaymsg -t get_outputs
-    std::string get_outputs();
+    // rect of the focused output in `swaymsg -t get_outputs`
+    std::optional<Geometry> focused_output();
+    // rect of the focused workspace in `swaymsg -t get_workspaces`
+    std::optional<Geometry> focused_workspace();
+    // con_id of the first window in `swaymsg -t get_tree` whose app_id or X11 class
+    // is one of `names`, ignoring ASCII case
+    std::optional<std::uint64_t> find_window(const std::vector<std::string_view>& names);
     
     // see sway-ipc (7)
     enum class Commands: std::uint32_t {
         Run = 0,
-        GetOutputs = 3
+        GetWorkspaces = 1,
+        GetOutputs = 3,
+        GetTree = 4
     };
     static constexpr std::array MAGIC { 'i', '3', '-', 'i', 'p', 'c' };
     static constexpr auto MAGIC_SIZE = MAGIC.size();
@@ -85,8 +95,13 @@ struct SwaySock {
     
     int                           sock_;
     std::array<char, HEADER_SIZE> header;
+    std::vector<char>             buffer;     // chunks of replies, reused
+    std::size_t                   remaining = 0;  // bytes of the reply payload not received yet
 
     void send_header_(std::uint32_t, Commands);
     void send_body_(std::string_view);
-    std::string recv_response_();
+    void recv_header_();
+    std::size_t recv_payload_(char*, std::size_t);
+    void drain_();
+    JsonScanner scan_reply_(Commands);
 };
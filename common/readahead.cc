@@ -0,0 +1,158 @@
+/*
+ * Startup readahead for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "nwg_tools.h"
+#include "readahead.h"
+
+namespace fs = std::filesystem;
+
+// recording is decided once in main, before any other thread starts
+static std::atomic<bool> recording{ false };
+static std::mutex noted_mutex;
+static std::vector<std::string> noted;
+
+// length 0 stands for the whole file
+struct Range {
+    std::uint64_t offset;
+    std::uint64_t length;
+};
+
+/*
+ * Brings the files listed in the manifest into the page cache
+ * */
+static void replay(fs::path manifest) {
+    std::ifstream in(manifest);
+    std::uint64_t offset, length;
+    std::string path;
+    while (in >> offset >> length) {
+        in.get(); // skip the separator, paths may contain spaces
+        if (!std::getline(in, path)) {
+            break;
+        }
+        auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        if (length == 0) {
+            struct stat st;
+            length = fstat(fd, &st) == 0 ? st.st_size : 0;
+        }
+#ifdef __linux__
+        readahead(fd, offset, length);
+#else
+        posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+#endif
+        close(fd);
+    }
+}
+
+StartupReadahead::StartupReadahead(std::string_view app) {
+    using namespace std::chrono_literals;
+    std::string_view mode;
+    if (auto env = getenv("NWG_READAHEAD")) {
+        mode = env;
+    }
+    if (mode == "off") {
+        return;
+    }
+    manifest = get_cache_home() / ("nwg-" + std::string{ app } + "-readahead");
+
+    std::error_code ec;
+    auto modified = fs::last_write_time(manifest, ec);
+    if (!ec) {
+        std::thread(replay, manifest).detach();
+    }
+    auto fresh = !ec && fs::file_time_type::clock::now() - modified < 24h * 7;
+    recording = mode == "record" || !fresh;
+}
+
+void StartupReadahead::note(const std::string& path) {
+    if (recording && !path.empty()) {
+        std::lock_guard lock{ noted_mutex };
+        noted.push_back(path);
+    }
+}
+
+/*
+ * Writes the noted files and the byte ranges of the files mapped by the process
+ * (shared libraries, GTK modules, icon caches, fonts) to the manifest
+ * */
+StartupReadahead::~StartupReadahead() {
+    if (!recording) {
+        return;
+    }
+    recording = false;
+    std::lock_guard lock{ noted_mutex };
+
+    std::map<std::string, std::vector<Range>> files;
+    for (auto& path : noted) {
+        files[path].push_back({ 0, 0 });
+    }
+    // start-end perms offset dev inode path
+    std::ifstream maps("/proc/self/maps");
+    for (std::string line; std::getline(maps, line);) {
+        std::istringstream in(line);
+        std::uint64_t start, end, offset;
+        std::string perms, dev, inode, path;
+        char dash;
+        if (!(in >> std::hex >> start >> dash >> end >> perms >> offset >> dev >> std::dec >> inode)) {
+            continue;
+        }
+        std::getline(in >> std::ws, path);
+        if (path.empty() || path[0] != '/' || path.find(" (deleted)") != path.npos) {
+            continue;
+        }
+        files[path].push_back({ offset, end - start });
+    }
+
+    auto tmp = manifest;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        for (auto& [path, ranges] : files) {
+            auto whole = std::any_of(ranges.begin(), ranges.end(), [](auto& r) { return r.length == 0; });
+            if (whole) {
+                out << "0 0 " << path << '\n';
+                continue;
+            }
+            // merge overlapping and adjacent mappings
+            std::sort(ranges.begin(), ranges.end(), [](auto& a, auto& b) { return a.offset < b.offset; });
+            auto merged = ranges.front();
+            for (auto& range : ranges) {
+                if (range.offset > merged.offset + merged.length) {
+                    out << merged.offset << ' ' << merged.length << ' ' << path << '\n';
+                    merged = range;
+                } else {
+                    auto end = std::max(merged.offset + merged.length, range.offset + range.length);
+                    merged.length = end - merged.offset;
+                }
+            }
+            out << merged.offset << ' ' << merged.length << ' ' << path << '\n';
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, manifest, ec);
+    if (ec) {
+        std::cerr << "ERROR: Failed to save " << manifest << ": " << ec.message() << '\n';
+    }
+}
@@ -0,0 +1,35 @@
+/*
+ * Startup readahead for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+/*
+ * Replays the files read during the previous startup into the page cache.
+ *
+ * On construction, the manifest `nwg-<app>-readahead` in the cache dir is read ahead
+ * from a background thread. If the manifest is missing or older than a week,
+ * the files passed to `note` and the files mapped by the process are recorded,
+ * and written to the manifest on destruction.
+ * NWG_READAHEAD=record forces recording, NWG_READAHEAD=off disables both.
+ * */
+class StartupReadahead {
+    public:
+        StartupReadahead(std::string_view app);
+        StartupReadahead(const StartupReadahead&) = delete;
+        ~StartupReadahead();
+
+        // remember `path` as a part of the working set, thread-safe
+        static void note(const std::string& path);
+    private:
+        std::filesystem::path manifest;
+};
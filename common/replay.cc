@@ -0,0 +1,202 @@
+/*
+ * Scripted input replay for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "replay.h"
+
+InputReplay::InputReplay() {
+    auto path = getenv("NWG_REPLAY");
+    if (!path) {
+        return;
+    }
+    std::ifstream script(path);
+    if (!script) {
+        std::cerr << "ERROR: Failed to open replay script " << path << '\n';
+        return;
+    }
+    for (std::string line; std::getline(script, line);) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream in(line);
+        unsigned delay;
+        std::string action;
+        if (!(in >> delay >> action)) {
+            std::cerr << "ERROR: Invalid replay line: " << line << '\n';
+            continue;
+        }
+        // skip the single separator, the text to type may start with a space
+        in.get();
+        std::string arg;
+        std::getline(in, arg);
+        if (action == "key") {
+            auto keyval = gdk_keyval_from_name(arg.c_str());
+            if (keyval == GDK_KEY_VoidSymbol) {
+                std::cerr << "ERROR: Unknown key name: " << arg << '\n';
+                continue;
+            }
+            steps.push_back({ Step::Key, delay, keyval, 0, 0 });
+        } else if (action == "type") {
+            Glib::ustring text{ arg };
+            for (auto c : text) {
+                steps.push_back({ Step::Key, delay, gdk_unicode_to_keyval(c), 0, 0 });
+            }
+        } else if (action == "hover") {
+            std::istringstream coords(arg);
+            int x, y;
+            if (!(coords >> x >> y)) {
+                std::cerr << "ERROR: Invalid hover coordinates: " << arg << '\n';
+                continue;
+            }
+            steps.push_back({ Step::Hover, delay, 0, x, y });
+        } else {
+            std::cerr << "ERROR: Unknown replay action: " << action << '\n';
+        }
+    }
+}
+
+InputReplay::~InputReplay() {
+    if (hovered) {
+        g_object_remove_weak_pointer(G_OBJECT(hovered), reinterpret_cast<gpointer*>(&hovered));
+    }
+}
+
+void InputReplay::start(Gtk::Widget& target) {
+    if (!enabled()) {
+        return;
+    }
+    this->target = &target;
+    schedule_();
+}
+
+void InputReplay::schedule_() {
+    if (next < steps.size()) {
+        Glib::signal_timeout().connect(sigc::mem_fun(*this, &InputReplay::on_timeout_), steps[next].delay);
+    }
+}
+
+bool InputReplay::on_timeout_() {
+    auto& step = steps[next++];
+    auto toplevel = gtk_widget_get_toplevel(target->gobj());
+    if (auto window = gtk_widget_get_window(toplevel)) {
+        if (step.action == Step::Key) {
+            press_(window, step.keyval);
+        } else {
+            hover_(toplevel, step.x, step.y);
+        }
+    }
+    schedule_();
+    return false; // one-shot, the next step has its own timeout
+}
+
+/*
+ * Synthesizes press and release of `keyval`, as if it came from the keyboard
+ * */
+void InputReplay::press_(GdkWindow* window, guint keyval) {
+    auto display = gdk_window_get_display(window);
+    auto keyboard = gdk_seat_get_keyboard(gdk_display_get_default_seat(display));
+    GdkKeymapKey* keys = nullptr;
+    gint n_keys = 0;
+    gdk_keymap_get_entries_for_keyval(gdk_keymap_get_for_display(display), keyval, &keys, &n_keys);
+    char text[8] = { 0 };
+    g_unichar_to_utf8(gdk_keyval_to_unicode(keyval), text);
+    for (auto type : { GDK_KEY_PRESS, GDK_KEY_RELEASE }) {
+        auto event = gdk_event_new(type);
+        event->key.window = GDK_WINDOW(g_object_ref(window));
+        event->key.send_event = TRUE;
+        event->key.time = GDK_CURRENT_TIME;
+        event->key.keyval = keyval;
+        event->key.string = g_strdup(text);
+        event->key.length = std::strlen(text);
+        if (n_keys > 0) {
+            event->key.hardware_keycode = keys[0].keycode;
+            event->key.group = keys[0].group;
+        }
+        gdk_event_set_device(event, keyboard);
+        gtk_main_do_event(event);
+        gdk_event_free(event);
+    }
+    g_free(keys);
+}
+
+struct HitTest {
+    GtkWidget* toplevel;
+    int        x;
+    int        y;
+    GtkWidget* found;
+};
+
+// finds the deepest drawn widget containing the point
+static void hit_test(GtkWidget* widget, gpointer data) {
+    auto& test = *static_cast<HitTest*>(data);
+    int x, y;
+    if (!gtk_widget_is_drawable(widget) ||
+        !gtk_widget_translate_coordinates(test.toplevel, widget, test.x, test.y, &x, &y)) {
+        return;
+    }
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(widget, &allocation);
+    if (x < 0 || y < 0 || x >= allocation.width || y >= allocation.height) {
+        return;
+    }
+    test.found = widget;
+    if (GTK_IS_CONTAINER(widget)) {
+        gtk_container_forall(GTK_CONTAINER(widget), &hit_test, data);
+    }
+}
+
+/*
+ * Synthesizes the crossing events of moving the pointer from the hovered button
+ * to the one at `x`, `y`, which prelight them as the real pointer would
+ * */
+void InputReplay::hover_(GtkWidget* toplevel, int x, int y) {
+    HitTest test{ toplevel, x, y, nullptr };
+    hit_test(toplevel, &test);
+    auto button = test.found;
+    while (button && !GTK_IS_BUTTON(button)) {
+        button = gtk_widget_get_parent(button);
+    }
+    if (button == hovered) {
+        return;
+    }
+    auto display = gtk_widget_get_display(toplevel);
+    auto pointer = gdk_seat_get_pointer(gdk_display_get_default_seat(display));
+    auto cross = [pointer](GtkWidget* widget, GdkEventType type, int x, int y) {
+        auto window = gtk_button_get_event_window(GTK_BUTTON(widget));
+        if (!window) {
+            return;
+        }
+        auto event = gdk_event_new(type);
+        event->crossing.window = GDK_WINDOW(g_object_ref(window));
+        event->crossing.send_event = TRUE;
+        event->crossing.time = GDK_CURRENT_TIME;
+        event->crossing.x = x;
+        event->crossing.y = y;
+        event->crossing.mode = GDK_CROSSING_NORMAL;
+        event->crossing.detail = GDK_NOTIFY_NONLINEAR;
+        gdk_event_set_device(event, pointer);
+        gtk_main_do_event(event);
+        gdk_event_free(event);
+    };
+    if (hovered) {
+        g_object_remove_weak_pointer(G_OBJECT(hovered), reinterpret_cast<gpointer*>(&hovered));
+        cross(hovered, GDK_LEAVE_NOTIFY, -1, -1);
+    }
+    hovered = button;
+    if (hovered) {
+        g_object_add_weak_pointer(G_OBJECT(hovered), reinterpret_cast<gpointer*>(&hovered));
+        int bx, by;
+        gtk_widget_translate_coordinates(toplevel, hovered, x, y, &bx, &by);
+        cross(hovered, GDK_ENTER_NOTIFY, bx, by);
+    }
+}
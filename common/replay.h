@@ -0,0 +1,52 @@
+/*
+ * Scripted input replay for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <gtkmm.h>
+
+/*
+ * Feeds key and pointer events read from the script file in NWG_REPLAY to a widget's
+ * toplevel, to make latency measurements reproducible. Each script line is one of
+ *   <delay_ms> key <keyname>    press and release a key, e.g. `120 key BackSpace`
+ *   <delay_ms> type <text>      type <text> one character each <delay_ms>
+ *   <delay_ms> hover <x> <y>    move the pointer into the button at <x> <y> of the toplevel,
+ *                               leaving the previously hovered one
+ * Lines starting with '#' are ignored.
+ * */
+class InputReplay : public sigc::trackable {
+    public:
+        InputReplay();
+        InputReplay(const InputReplay&) = delete;
+        ~InputReplay();
+
+        bool enabled() const { return !steps.empty(); }
+        // starts replaying once the main loop runs; `target` must outlive the replay
+        void start(Gtk::Widget& target);
+    private:
+        struct Step {
+            enum Action { Key, Hover } action;
+            unsigned delay;  // ms
+            guint    keyval; // Key
+            int      x;      // Hover
+            int      y;
+        };
+        std::vector<Step>   steps;
+        std::size_t         next = 0;
+        Gtk::Widget*        target = nullptr;
+        GtkWidget*          hovered = nullptr; // weak pointer
+
+        void schedule_();
+        bool on_timeout_();
+        void press_(GdkWindow* window, guint keyval);
+        void hover_(GtkWidget* toplevel, int x, int y);
+};
@@ -0,0 +1,49 @@
+/*
+ * Single-producer single-consumer queue for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Lock-free ring of `Capacity - 1` elements, for handing data from one thread
+ * to exactly one other. `push` is only called by the producer, `pop` only by the consumer.
+ * */
+template <typename T, std::size_t Capacity>
+class SpscQueue {
+    public:
+        // moves `value` in, returns false if the queue is full
+        bool push(T& value) {
+            auto tail = tail_.load(std::memory_order_relaxed);
+            auto next = (tail + 1) % Capacity;
+            if (next == head_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            slots[tail] = std::move(value);
+            tail_.store(next, std::memory_order_release);
+            return true;
+        }
+        // moves the oldest element to `value`, returns false if the queue is empty
+        bool pop(T& value) {
+            auto head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            value = std::move(slots[head]);
+            head_.store((head + 1) % Capacity, std::memory_order_release);
+            return true;
+        }
+    private:
+        std::array<T, Capacity> slots;
+        // on separate cache lines, each is written by one side only
+        alignas(64) std::atomic<std::size_t> head_{ 0 };
+        alignas(64) std::atomic<std::size_t> tail_{ 0 };
+};
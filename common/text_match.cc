@@ -0,0 +1,244 @@
+/*
+ * Substring search for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#include <algorithm>
+#include <array>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define NWG_MATCH_X86
+#endif
+
+#include "text_match.h"
+
+static constexpr auto npos = std::string_view::npos;
+
+static unsigned char fold(char c) {
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static bool equal_folded(const char* a, const char* b, std::size_t size) {
+    for (std::size_t i = 0; i < size; i++) {
+        if (fold(a[i]) != fold(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Position of `needle` in `haystack` from `from` on; `needle` is not empty and not longer
+ * */
+static std::size_t find_scalar(std::string_view haystack, std::string_view needle, std::size_t from) {
+    auto first = fold(needle[0]);
+    for (auto i = from; i + needle.size() <= haystack.size(); i++) {
+        if (fold(haystack[i]) == first && equal_folded(haystack.data() + i + 1, needle.data() + 1, needle.size() - 1)) {
+            return i;
+        }
+    }
+    return npos;
+}
+
+static bool is_ascii_scalar(std::string_view text) {
+    return std::none_of(text.begin(), text.end(), [](char c) { return c & 0x80; });
+}
+
+static std::size_t find_with_scalar(std::string_view haystack, std::string_view needle) {
+    if (needle.empty() || needle.size() > haystack.size()) {
+        return needle.empty() ? 0 : npos;
+    }
+    return find_scalar(haystack, needle, 0);
+}
+
+#ifdef NWG_MATCH_X86
+
+/*
+ * The 16 byte kernel is plain SSE2, which every x86-64 CPU has; it is inlined into the AVX2 one,
+ * so that it is encoded as AVX there and switching between the two costs nothing
+ * */
+#define NWG_INLINE inline __attribute__((always_inline))
+
+/*
+ * 16 bytes with the ASCII upper case letters made lower case; bytes above 0x7F are negative
+ * in the signed comparisons, so they are left as they are
+ * */
+static NWG_INLINE __m128i load16(const char* data) {
+    auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    auto upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('A' - 1)),
+                               _mm_cmplt_epi8(bytes, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(bytes, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+static NWG_INLINE __m256i load32(const char* data) {
+    auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    auto upper = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('A' - 1)),
+                                  _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), bytes));
+    return _mm256_or_si256(bytes, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+/*
+ * Checks the positions set in `mask` from `at` on, where the first and the last byte of `needle` match
+ * */
+static NWG_INLINE std::size_t check(const char* haystack, std::string_view needle, std::size_t at, unsigned mask) {
+    auto middle = needle.size() > 2 ? needle.size() - 2 : 0;
+    for (; mask; mask &= mask - 1) {
+        auto i = at + __builtin_ctz(mask);
+        if (equal_folded(haystack + i + 1, needle.data() + 1, middle)) {
+            return i;
+        }
+    }
+    return npos;
+}
+
+/*
+ * The positions from `at` on, among the 16 ones of a block, where the first and the last byte of `needle` match
+ * */
+static NWG_INLINE unsigned candidates16(const char* haystack, std::string_view needle, std::size_t at) {
+    auto starts = _mm_cmpeq_epi8(load16(haystack + at), _mm_set1_epi8(fold(needle[0])));
+    auto ends = _mm_cmpeq_epi8(load16(haystack + at + needle.size() - 1), _mm_set1_epi8(fold(needle.back())));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(starts, ends)));
+}
+
+/*
+ * Position of `needle` in `haystack` from `from` on, 16 positions at a time. The last positions are
+ * checked in a block overlapping the previous one, or in a padded copy of a short haystack
+ * */
+static NWG_INLINE std::size_t find16(std::string_view haystack, std::string_view needle, std::size_t from) {
+    auto positions = haystack.size() - needle.size() + 1;
+    if (from >= positions) {
+        return npos;
+    }
+    if (positions < 16) {
+        constexpr std::size_t PADDED = 128;
+        if (haystack.size() + 16 > PADDED) {
+            return find_scalar(haystack, needle, from);
+        }
+        char padded[PADDED];
+        std::copy(haystack.begin(), haystack.end(), padded);
+        std::fill(padded + haystack.size(), padded + haystack.size() + 16, '\0');
+        auto mask = candidates16(padded, needle, 0) & ((1u << positions) - 1) & ~((1u << from) - 1);
+        return check(padded, needle, 0, mask);
+    }
+    auto i = from;
+    for (; i + 16 <= positions; i += 16) {
+        if (auto found = check(haystack.data(), needle, i, candidates16(haystack.data(), needle, i)); found != npos) {
+            return found;
+        }
+    }
+    if (i == positions) {
+        return npos;
+    }
+    // the positions before `i` were checked already
+    auto last = positions - 16;
+    auto mask = candidates16(haystack.data(), needle, last) & ~((1u << (i - last)) - 1);
+    return check(haystack.data(), needle, last, mask);
+}
+
+static std::size_t find_with_sse2(std::string_view haystack, std::string_view needle) {
+    if (needle.empty() || needle.size() > haystack.size()) {
+        return needle.empty() ? 0 : npos;
+    }
+    return find16(haystack, needle, 0);
+}
+
+__attribute__((target("avx2")))
+static std::size_t find_with_avx2(std::string_view haystack, std::string_view needle) {
+    if (needle.empty() || needle.size() > haystack.size()) {
+        return needle.empty() ? 0 : npos;
+    }
+    auto positions = haystack.size() - needle.size() + 1;
+    auto first = _mm256_set1_epi8(fold(needle[0]));
+    auto last = _mm256_set1_epi8(fold(needle.back()));
+    std::size_t i = 0;
+    for (; i + 32 <= positions; i += 32) {
+        auto starts = _mm256_cmpeq_epi8(load32(haystack.data() + i), first);
+        auto ends = _mm256_cmpeq_epi8(load32(haystack.data() + i + needle.size() - 1), last);
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(starts, ends)));
+        if (auto found = check(haystack.data(), needle, i, mask); found != npos) {
+            return found;
+        }
+    }
+    // most names and commands are shorter than 32 bytes
+    return find16(haystack, needle, i);
+}
+
+static NWG_INLINE bool is_ascii16(std::string_view text, std::size_t from) {
+    auto i = from;
+    auto high = _mm_setzero_si128();
+    for (; i + 16 <= text.size(); i += 16) {
+        high = _mm_or_si128(high, _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i)));
+    }
+    return !_mm_movemask_epi8(high) && is_ascii_scalar(text.substr(i));
+}
+
+static bool is_ascii_sse2(std::string_view text) {
+    return is_ascii16(text, 0);
+}
+
+__attribute__((target("avx2")))
+static bool is_ascii_avx2(std::string_view text) {
+    std::size_t i = 0;
+    auto high = _mm256_setzero_si256();
+    for (; i + 32 <= text.size(); i += 32) {
+        high = _mm256_or_si256(high, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + i)));
+    }
+    return !_mm256_movemask_epi8(high) && is_ascii16(text, i);
+}
+
+#endif
+
+namespace {
+    struct Kernel {
+        std::string_view name;
+        bool             (*is_ascii)(std::string_view);
+        std::size_t      (*find_ascii_nocase)(std::string_view, std::string_view);
+        bool             (*supported)();
+    };
+}
+
+static constexpr std::array kernels {
+#ifdef NWG_MATCH_X86
+    Kernel{ "avx2", is_ascii_avx2, find_with_avx2, []() -> bool { return __builtin_cpu_supports("avx2"); } },
+    Kernel{ "sse2", is_ascii_sse2, find_with_sse2, []() { return true; } },
+#endif
+    Kernel{ "scalar", is_ascii_scalar, find_with_scalar, []() { return true; } }
+};
+
+// scalar until the first kernel the CPU supports is chosen, before main
+static const Kernel* kernel = &kernels.back();
+static const bool chosen = []() {
+#ifdef NWG_MATCH_X86
+    __builtin_cpu_init();
+#endif
+    kernel = &*std::find_if(kernels.begin(), kernels.end(), [](auto& k) { return k.supported(); });
+    return true;
+}();
+
+bool is_ascii(std::string_view text) {
+    return kernel->is_ascii(text);
+}
+
+std::size_t find_ascii_nocase(std::string_view haystack, std::string_view needle) {
+    return kernel->find_ascii_nocase(haystack, needle);
+}
+
+std::string_view match_kernel() {
+    return kernel->name;
+}
+
+bool set_match_kernel(std::string_view name) {
+    for (auto& k : kernels) {
+        if (k.name == name && k.supported()) {
+            kernel = &k;
+            return true;
+        }
+    }
+    return false;
+}
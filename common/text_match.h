@@ -0,0 +1,32 @@
+/*
+ * Substring search for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+/*
+ * Case insensitive search of short phrases in many short texts, such as the names and commands
+ * filtered on each keystroke. On x86-64 the candidates are found 16 or 32 positions at a time by
+ * comparing the first and the last byte of the phrase, with SSE2 or AVX2 as the CPU supports.
+ * Only ASCII letters are folded, callers fold other text with Glib. Exact search is left
+ * to std::string_view::find, whose memchr is as fast on texts this short
+ * */
+
+// whether no byte of `text` is above 0x7F
+bool is_ascii(std::string_view text);
+// position of `needle` in `haystack` comparing ASCII letters regardless of case, or npos;
+// the other bytes must be equal
+std::size_t find_ascii_nocase(std::string_view haystack, std::string_view needle);
+
+// the kernel in use: "avx2", "sse2" or "scalar"
+std::string_view match_kernel();
+// uses the kernel `name` if the CPU supports it, returns whether it does; for benchmarks
+bool set_match_kernel(std::string_view name);
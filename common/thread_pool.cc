@@ -0,0 +1,80 @@
+/*
+ * Thread pool for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#include <algorithm>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(std::size_t threads) {
+    for (std::size_t t = 0; t < threads; t++) {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock{ mutex };
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool{ std::clamp(std::thread::hardware_concurrency(), 1u, 8u) - 1 };
+    return pool;
+}
+
+void ThreadPool::take_tasks() {
+    for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+        (*task)(i);
+    }
+}
+
+void ThreadPool::run(std::size_t count_, const std::function<void(std::size_t)>& task_) {
+    if (workers.empty() || count_ < 2) {
+        for (std::size_t i = 0; i < count_; i++) {
+            task_(i);
+        }
+        return;
+    }
+    {
+        std::lock_guard lock{ mutex };
+        task = &task_;
+        count = count_;
+        next = 0;
+        busy = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+    take_tasks();
+    std::unique_lock lock{ mutex };
+    finished.wait(lock, [this]() { return busy == 0; });
+    task = nullptr;
+}
+
+void ThreadPool::work() {
+    std::uint64_t done = 0;
+    std::unique_lock lock{ mutex };
+    while (true) {
+        wake.wait(lock, [this, done]() { return stopping || generation != done; });
+        if (stopping) {
+            return;
+        }
+        done = generation;
+        lock.unlock();
+        take_tasks();
+        lock.lock();
+        if (--busy == 0) {
+            finished.notify_one();
+        }
+    }
+}
@@ -0,0 +1,54 @@
+/*
+ * Thread pool for nwg-launchers
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Workers kept waiting for numbered tasks, so that splitting work which takes
+ * a few milliseconds between threads does not cost starting them each time.
+ * `run` is called from one thread at a time, which takes tasks as well
+ * */
+class ThreadPool {
+    public:
+        // starts `threads` workers besides the caller of `run`
+        explicit ThreadPool(std::size_t threads);
+        ThreadPool(const ThreadPool&) = delete;
+        ~ThreadPool();
+
+        // number of threads taking tasks, the caller of `run` included
+        std::size_t size() const { return workers.size() + 1; }
+        // calls `task(i)` for each i < `count`, lower `i` first; returns once all the calls returned
+        void run(std::size_t count, const std::function<void(std::size_t)>& task);
+
+        // a pool with a thread per CPU, up to 8, started on first use
+        static ThreadPool& shared();
+    private:
+        std::vector<std::thread>                    workers;
+        std::mutex                                  mutex;
+        std::condition_variable                     wake;
+        std::condition_variable                     finished;
+        const std::function<void(std::size_t)>*     task = nullptr;
+        std::size_t                                 count = 0;
+        std::atomic<std::size_t>                    next{ 0 };
+        std::size_t                                 busy = 0;        // workers still taking tasks of this run
+        std::uint64_t                               generation = 0;  // of the run
+        bool                                        stopping = false;
+
+        void work();
+        void take_tasks();
+};
@@ -11,10 +11,16 @@
 #include <unistd.h>
 
 #include <charconv>
+#include <clocale>
+#include <limits>
+#include <optional>
 
 #include "nwg_tools.h"
 #include "nwg_classes.h"
+#include "alloc_stats.h"
 #include "on_event.h"
+#include "readahead.h"
+#include "replay.h"
 #include "dmenu.h"
 
 #define ROWS_DEFAULT 20
@@ -29,7 +35,8 @@ std::string wm {""};                        // detected or forced window manager
 std::string settings_file {""};
 
 int rows = ROWS_DEFAULT;                    // number of menu items to display
-std::vector<Glib::ustring> all_commands {};
+CommandList all_commands;
+History history;
 
 bool dmenu_run = false;
 bool show_searchbox = true;
@@ -49,12 +56,18 @@ Options:\n\
 -o <opacity>     background opacity (0.0 - 1.0, default 0.3)\n\
 -b <background>  background colour in RRGGBB or RRGGBBAA format (RRGGBBAA alpha overrides <opacity>)\n\
 -wm <wmname>     window manager name (if can not be detected)\n\
--run             ignore stdin, always build from commands in $PATH\n\n\
+-run             ignore stdin, always build from commands in $PATH\n\
+--sort           sort stdin lines case insensitive\n\
+--unique         drop repeated stdin lines\n\
+--history <name> name of the history of stdin selections (default: stdin)\n\
+--filter <query> print the commands matching <query> (all, or the first <rows> with -r) and exit, without a display\n\n\
 Hotkeys:\n\
 Delete        clear search box\n\
 Insert        switch case sensitivity\n";
 
 int main(int argc, char *argv[]) {
+    // the commands are sorted, and their cache keyed, by LC_COLLATE before Gtk sets the locale
+    setlocale(LC_ALL, "");
     std::string custom_css_file {"style.css"};
 
     // For now the settings file only determines if case_sensitive was turned on.
@@ -65,14 +78,26 @@ int main(int argc, char *argv[]) {
         case_sensitive = sensitivity == "case_sensitive";
     }
 
-    create_pid_file_or_kill_pid("nwgdmenu");
-
     InputParser input(argc, argv);
     if (input.cmdOptionExists("-h")){
         std::cout << HELP_MESSAGE;
         std::exit(0);
     }
 
+    // filtering leaves a running menu and the readahead manifest alone
+    auto filter = input.cmdOptionExists("--filter");
+    std::ostream matches{ std::cout.rdbuf() };
+    std::optional<StartupReadahead> readahead;
+    if (filter) {
+        // stdout is for the matches only
+        std::cout.rdbuf(std::cerr.rdbuf());
+    } else {
+        create_pid_file_or_kill_pid("nwgdmenu");
+        readahead.emplace("nwgdmenu");
+    }
+    AllocStats alloc_stats;
+    StartupReadahead::note(settings_file);
+
     // We will build dmenu out of commands found in $PATH if nothing has been passed by stdin
     dmenu_run = isatty(STDIN_FILENO) == 1;
 
@@ -80,12 +105,11 @@ int main(int argc, char *argv[]) {
         dmenu_run = true;
     }
 
-    // Otherwise let's build from stdin input
-    if (!dmenu_run) {
-        all_commands = {};
-        for (std::string line; std::getline(std::cin, line);) {
-            all_commands.emplace_back(std::move(line));
-        }
+    // Otherwise let's build from stdin input: mapped if it is a file, or read in background while GTK starts
+    AllocStats::phase("stdin");
+    std::optional<StdinReader> reader;
+    if (!dmenu_run && !all_commands.map(STDIN_FILENO)) {
+        reader.emplace(STDIN_FILENO);
     }
 
     if (input.cmdOptionExists("-n")){
@@ -135,6 +159,45 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    AllocStats::phase("commands");
+    if (dmenu_run) {
+        /* get a sorted list of the commands in $PATH, cached until a directory changes */
+        load_commands(all_commands);
+        std::cout << all_commands.size() << " commands found\n";
+    } else if (auto sort = input.cmdOptionExists("--sort"), unique = input.cmdOptionExists("--unique"); sort || unique) {
+        // both need the whole input
+        if (reader) {
+            reader->read(all_commands, std::numeric_limits<std::size_t>::max());
+        }
+        if (unique) {
+            all_commands.select(unique_lines(all_commands));
+        }
+        if (sort) {
+            all_commands.select(sort_lines(all_commands));
+        }
+    }
+
+    // selections are ranked separately for each input source
+    auto source = input.getCmdOption("--history");
+    history.load(dmenu_run ? "run" : source.empty() ? "stdin" : source);
+
+    // --filter prints what the menu would show for the query and exits
+    if (filter) {
+        if (reader) {
+            reader->read(all_commands, std::numeric_limits<std::size_t>::max());
+        }
+        history.update(all_commands);
+        AllocStats::phase("filter");
+        auto query = input.getCmdOption("--filter");
+        auto limit = rw.empty() ? -1 : rows;
+        auto phrase = Glib::ustring{ std::string{ query } };
+        for (auto i : filter_commands(all_commands, phrase, case_sensitive, limit, &history)) {
+            matches << all_commands[i] << '\n';
+        }
+        matches.flush();
+        return EXIT_SUCCESS;
+    }
+
     auto config_dir = get_config_dir("nwgdmenu");
     if (!fs::is_directory(config_dir)) {
         std::cout << "Config dir not found, creating...\n";
@@ -159,35 +222,7 @@ int main(int argc, char *argv[]) {
         wm = detect_wm();
     }
 
-    if (dmenu_run) {
-        /* get a list of paths to all commands from all application dirs */
-        std::vector<std::string> commands = list_commands();
-        std::cout << commands.size() << " commands found\n";
-
-        /* Create a vector of commands (w/o path) */
-        all_commands = {};
-        for (auto&& command : commands) {
-            auto cmd = take_last_by(command, "/");
-            if (cmd.find(".") != 0 && cmd.size() != 1) {
-                all_commands.emplace_back(cmd.data(), cmd.size());
-            }
-        }
-
-        /* Sort case insensitive */
-        std::sort(all_commands.begin(), all_commands.end(), [](auto& a, auto& b) {
-            return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](auto a, auto b) {
-                return std::tolower(a) < std::tolower(b);
-            });
-        });
-    }
-
-    /* turn off borders, enable floating on sway */
-    if (wm == "sway") {
-        SwaySock sock;
-        sock.run("for_window [title=\"~nwgdmenu*\"] floating enable");
-        sock.run("for_window [title=\"~nwgdmenu*\"] border none");
-    }
-
+    AllocStats::phase("window");
     auto app = Gtk::Application::create();
 
     auto provider = Gtk::CssProvider::create();
@@ -199,72 +234,116 @@ int main(int argc, char *argv[]) {
     }
     Gtk::StyleContext::add_provider_for_screen(screen, provider, GTK_STYLE_PROVIDER_PRIORITY_USER);
 
+    /* turn off borders, enable floating on sway, unless shown as a layer surface */
+    if (wm == "sway" && !CommonWindow::layer_shell_supported()) {
+        SwaySock sock;
+        sock.run("for_window [title=\"~nwgdmenu*\"] floating enable");
+        sock.run("for_window [title=\"~nwgdmenu*\"] border none");
+    }
+
     if (std::filesystem::is_regular_file(css_file)) {
         provider->load_from_path(css_file);
+        StartupReadahead::note(css_file);
         std::cout << "Using " << css_file << '\n';
     } else {
         provider->load_from_path(default_css_file);
+        StartupReadahead::note(default_css_file);
         std::cout << "Using " << default_css_file << '\n';
     }
 
+    // the menu is shown once it can be filled, the rest of stdin is added as it comes
+    if (reader) {
+        reader->read(all_commands, rows);
+    }
+    history.update(all_commands);
+
     MainWindow window;
     window.set_background_color(background_color);
-    // For openbox and similar we'll need the window x, y coordinates
-    window.show();
+    // For openbox and similar we'll need the window x, y coordinates,
+    // a layer surface is only mapped by app->run
+    if (!window.is_layer_surface()) {
+        window.show();
+    }
 
     DMenu menu{window};
+    // searches scan the list until its indices are built, once all of it is there
+    std::optional<IndexBuilder> indexer;
+    auto build_index = [&indexer, &menu]() {
+        indexer.emplace(all_commands, [&menu](auto index, auto trigrams) {
+            menu.set_index(std::move(index), std::move(trigrams));
+        });
+    };
+    if (reader && !reader->done()) {
+        menu.set_loading(true);
+        reader->on_lines(all_commands, [&menu, &reader, &build_index](std::size_t from) {
+            menu.on_commands_added(from);
+            menu.set_loading(!reader->done());
+            if (reader->done()) {
+                build_index();
+            }
+        });
+    } else {
+        build_index();
+    }
     Anchor anchor{menu};
     window.anchor = &anchor;
 
     window.signal_button_press_event().connect(sigc::ptr_fun(&on_window_clicked));
 
-    /* Detect focused display geometry: {x, y, width, height} */
-    auto geometry = display_geometry(wm, display, window.get_window());
-    std::cout << "Focused display: " << geometry.x << ", " << geometry.y << ", " << geometry.width << ", "
-    << geometry.height << '\n';
-
-    int x = geometry.x;
-    int y = geometry.y;
-    int w = geometry.width;
-    int h = geometry.height;
-
-    if (wm == "sway" || wm == "i3") {
-        window.resize(w, h);
-        window.move(x, y);
-        window.hide();
+    if (window.is_layer_surface()) {
+        // the compositor sizes the surface to the output in its first configure
+        window.signal_size_allocate().connect([&menu](Gtk::Allocation& allocation) {
+            menu.set_property("width_request", allocation.get_width() / 8);
+        });
     } else {
-        window.hide();
-        int x_org;
-        int y_org;
-        window.resize(1, 1);
-        if (!h_align.empty() || !v_align.empty()) {
+        /* Detect focused display geometry: {x, y, width, height} */
+        auto geometry = display_geometry(wm, display, window.get_window());
+        std::cout << "Focused display: " << geometry.x << ", " << geometry.y << ", " << geometry.width << ", "
+        << geometry.height << '\n';
+
+        int x = geometry.x;
+        int y = geometry.y;
+        int w = geometry.width;
+        int h = geometry.height;
+
+        if (wm == "sway" || wm == "i3") {
+            window.resize(w, h);
             window.move(x, y);
+            window.hide();
+        } else {
+            window.hide();
+            int x_org;
+            int y_org;
+            window.resize(1, 1);
+            if (!h_align.empty() || !v_align.empty()) {
+                window.move(x, y);
+                window.get_position(x_org, y_org);
+            }
+            // We assume that the window has been opened at mouse pointer coordinates
             window.get_position(x_org, y_org);
-        }
-        // We assume that the window has been opened at mouse pointer coordinates
-        window.get_position(x_org, y_org);
 
-        if (h_align == "l") {
-            window.move(x, y_org);
-            window.get_position(x_org, y_org);
-        }
-        if (h_align == "r") {
-            window.move(x + w - 50, y_org);
-            window.get_position(x_org, y_org);
-        }
-        if (v_align == "t") {
-            window.move(x_org, y);
-            window.get_position(x_org, y_org);
-        }
-        if (v_align == "b") {
-            window.move(x_org, y + h);
+            if (h_align == "l") {
+                window.move(x, y_org);
+                window.get_position(x_org, y_org);
+            }
+            if (h_align == "r") {
+                window.move(x + w - 50, y_org);
+                window.get_position(x_org, y_org);
+            }
+            if (v_align == "t") {
+                window.move(x_org, y);
+                window.get_position(x_org, y_org);
+            }
+            if (v_align == "b") {
+                window.move(x_org, y + h);
+            }
+            //~ window.hide();
         }
-        //~ window.hide();
+        menu.set_property("width_request", w / 8);
     }
 
     menu.signal_deactivate().connect(sigc::mem_fun(window, &MainWindow::close));
     menu.set_reserve_toggle_size(false);
-    menu.set_property("width_request", w / 8);
 
     Gtk::Box outer_box(Gtk::ORIENTATION_VERTICAL);
     outer_box.set_spacing(15);
@@ -295,5 +374,9 @@ int main(int argc, char *argv[]) {
 
     menu.show_all();
 
+    InputReplay replay;
+    replay.start(menu);
+
+    AllocStats::phase("run");
     return app->run(window);
 }
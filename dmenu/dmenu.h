@@ -16,6 +16,14 @@
 #include <filesystem>
 #include <regex>
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 
 #include <gtkmm.h>
 #include <glibmm/ustring.h>
@@ -24,6 +32,7 @@
 
 #include "nwgconfig.h"
 #include "nwg_classes.h"
+#include "thread_pool.h"
 
 namespace fs = std::filesystem;
 namespace ns = nlohmann;
@@ -33,18 +42,255 @@ extern std::string v_align;
 extern std::string wm;
 extern std::string settings_file;
 
+/*
+ * Lines of the input in one buffer, read or mapped from a regular file, indexed
+ * by the offsets of their starts; a line is only copied when it becomes a menu item
+ * */
+class CommandList {
+    public:
+        CommandList() = default;
+        CommandList(const CommandList&) = delete;
+        CommandList& operator=(const CommandList&) = delete;
+        ~CommandList();
+
+        std::size_t size() const { return starts.size() - 1; }
+        bool empty() const { return size() == 0; }
+        // the line without its '\n', valid until the next append
+        std::string_view operator[](std::size_t i) const {
+            return { data + starts[i], starts[i + 1] - starts[i] - 1 };
+        }
+        // appends a line not containing '\n'
+        void push_back(std::string_view line);
+        // appends complete lines, each ending with '\n'
+        void append(std::string_view text);
+        // maps the rest of `fd` if it is a regular file, returns false otherwise
+        bool map(int fd);
+        // keeps only the lines at `indices`, in that order
+        void select(const std::vector<std::size_t>& indices);
+    private:
+        std::vector<char>        buffer;              // appended lines
+        const char*              data = nullptr;      // the lines, in `buffer` or `mapping`
+        void*                    mapping = nullptr;
+        std::size_t              mapping_size = 0;
+        std::vector<std::size_t> starts{ 0 };         // line starts in `data`, then the end + 1
+
+        void index(std::size_t from, std::size_t to);
+};
+
+/*
+ * Selections made from one input source, ranked by their use decayed with age ("frecency").
+ * Each selection is appended to `nwg-dmenu-history/<source>` in the cache dir,
+ * which is rewritten with one line per command once it grows long
+ * */
+class History {
+    public:
+        // reads the history of `source`, e.g. "run"
+        void load(std::string_view source);
+        // looks up the commands added since the last update, returns whether any has a history
+        bool update(const CommandList& commands);
+        // number of the commands with a history found in the list
+        std::size_t size() const { return found.size(); }
+        // index of the i-th of them in the list, increasing with i, and its score
+        std::size_t index(std::size_t i) const { return found[i].index; }
+        double score(std::size_t i) const { return found[i].score; }
+        // indices of the commands with a history, the best ranked first
+        std::vector<std::size_t> ranked() const;
+        // records the selection of `command`
+        void record(std::string_view command);
+    private:
+        struct Entry {
+            double score = 0;
+            bool   found = false;  // only the first occurrence in the list is ranked
+        };
+        struct Found {
+            std::size_t index;
+            double      score;
+        };
+        fs::path                                      file;
+        std::string                                   contents;  // the file, owns the keys of `entries`
+        std::unordered_map<std::string_view, Entry>   entries;
+        std::size_t                                   records = 0;
+        std::size_t                                   scanned = 0;
+        std::vector<Found>                            found;
+};
+
+/*
+ * Indices of the lines of a complete CommandList sorted by their text and by their
+ * upper case text, so that the lines starting with a phrase are found by binary search
+ * */
+class PrefixIndex {
+    public:
+        // stops early, covering no lines, once `cancelled` is set
+        explicit PrefixIndex(const CommandList& commands, const std::atomic<bool>* cancelled = nullptr);
+
+        // number of lines indexed
+        std::size_t size() const { return sorted.size(); }
+        // appends to `result` the indices of up to `limit` lines starting with `phrase`, the first
+        // ones in the list; `phrase` is upper case unless `case_sensitive`. Returns the number of all of them
+        std::size_t starting_with(const CommandList& commands,
+                                  std::string_view phrase,
+                                  bool case_sensitive,
+                                  std::size_t limit,
+                                  std::vector<std::size_t>& result) const;
+    private:
+        std::vector<std::uint32_t>                     sorted;         // by text
+        std::vector<std::uint32_t>                     sorted_upper;   // by upper case text
+        std::vector<std::uint32_t>                     position;       // of each line in `sorted`
+        std::vector<std::uint32_t>                     position_upper; // of each line in `sorted_upper`
+        std::unordered_map<std::uint32_t, std::string> upper;          // upper case text of non-ASCII lines
+
+        std::string_view upper_key(const CommandList& commands, std::uint32_t i) const;
+};
+
+/*
+ * Posting lists of the lines of a complete CommandList containing each trigram of their
+ * upper case text, so that the lines which may contain a phrase are found without a scan.
+ * Trigrams are hashed to buckets, a list holds the deltas of increasing line indices as varints
+ * */
+class TrigramIndex {
+    public:
+        // stops early, covering no lines, once `cancelled` is set
+        explicit TrigramIndex(const CommandList& commands, const std::atomic<bool>* cancelled = nullptr);
+
+        // number of lines indexed
+        std::size_t size() const { return lines; }
+        // memory used by the lists
+        std::size_t bytes() const { return offsets.size() * sizeof(offsets[0]) + postings.size(); }
+        // calls `fn` with the increasing indices of the lines which may contain `phrase`, a superset
+        // of the ones which do, until it returns false; `phrase` is upper case unless `case_sensitive`.
+        // Returns false, leaving the lines to be scanned, if `phrase` is shorter than a trigram
+        bool candidates(std::string_view phrase,
+                        bool case_sensitive,
+                        const std::function<bool(std::size_t)>& fn) const;
+    private:
+        class Postings;
+
+        std::size_t                 lines;
+        unsigned                    bits;       // of a bucket number
+        std::vector<std::size_t>    offsets;    // of the list of each bucket in `postings`, then the end
+        std::vector<std::uint8_t>   postings;
+};
+
+/*
+ * Builds the indices of a complete CommandList on a background thread
+ * and hands each one over in the main loop as soon as it is built
+ * */
+class IndexBuilder {
+    public:
+        // called with the indices built so far
+        using Callback = std::function<void(std::shared_ptr<const PrefixIndex>, std::shared_ptr<const TrigramIndex>)>;
+
+        // `commands` must not change any more
+        IndexBuilder(const CommandList& commands, Callback callback);
+        IndexBuilder(const IndexBuilder&) = delete;
+        // stops and waits for the thread, which reads `commands`
+        ~IndexBuilder();
+    private:
+        std::thread                                 thread;
+        std::mutex                                  mutex;
+        std::atomic<bool>                           cancelled{ false };
+        std::shared_ptr<const PrefixIndex>          index;
+        std::shared_ptr<const TrigramIndex>         trigrams;
+        Callback                                    callback;
+        Glib::Dispatcher                            dispatcher;
+};
+
 extern int rows;
-extern std::vector<Glib::ustring> all_commands;
+extern CommandList all_commands;
+extern History history;
 
 extern bool dmenu_run;
 extern bool show_searchbox;
 extern bool case_sensitive;
 
+/*
+ * Matches of a phrase in a list of commands which may grow: up to `limit` of them,
+ * the ones starting with the phrase go first; negative `limit` means no limit.
+ * Within both groups, the commands with a `history` go first, the best ranked first
+ * */
+class CommandFilter {
+    public:
+        CommandFilter(const Glib::ustring& phrase,
+                      bool case_sensitive,
+                      int limit,
+                      const History* history = nullptr,
+                      const PrefixIndex* index = nullptr,
+                      const TrigramIndex* trigrams = nullptr);
+
+        // matches the commands added since the last update, returns whether the result changed;
+        // the history must be updated first
+        bool update(const CommandList& commands);
+        // indices of the matching commands, in the order to show them
+        std::vector<std::size_t> result() const;
+        // splits long scans between the threads of `pool` instead of ThreadPool::shared()
+        void use_pool(ThreadPool& pool_) { pool = &pool_; }
+    private:
+        using Ranked = std::pair<double, std::size_t>;  // score, index
+
+        Glib::ustring            phrase;
+        bool                     case_sensitive;
+        std::size_t              limit;
+        const History*           history;
+        const PrefixIndex*       index;
+        const TrigramIndex*      trigrams;            // used along with `index`
+        ThreadPool*              pool = nullptr;
+        std::size_t              scanned = 0;
+        std::size_t              ranked_scanned = 0;  // commands of `history` matched
+        std::size_t              ranked_skipped = 0;  // commands of `history` passed by the scan
+        std::vector<std::size_t> prefix;              // starting with the phrase
+        std::vector<std::size_t> infix;               // containing it elsewhere
+        std::vector<Ranked>      ranked_prefix;
+        std::vector<Ranked>      ranked_infix;
+
+        std::size_t find(std::string_view command) const;
+        std::size_t count() const;
+        bool is_ranked(std::size_t i) const;
+        void update_indexed(const CommandList& commands);
+        bool scan_parallel(const CommandList& commands);
+};
+
+/*
+ * Reads lines of `fd` on a background thread, which hands them over in chunks
+ * through a lock-free queue, so that the menu can be shown before the input ends
+ * */
+class StdinReader {
+    public:
+        explicit StdinReader(int fd);
+        StdinReader(const StdinReader&) = delete;
+        ~StdinReader();
+
+        // appends the lines read so far to `lines`, waits until there are at least `count` or the input ends
+        void read(CommandList& lines, std::size_t count);
+        // appends the lines to `lines` in the main loop as they are read, then calls `callback`
+        // with the index of the first new line
+        void on_lines(CommandList& lines, std::function<void(std::size_t)> callback);
+        // whether the input ended and all of it was handed over
+        bool done() const { return finished; }
+
+        struct State;
+    private:
+        std::shared_ptr<State>                 state;
+        CommandList*                           target = nullptr;
+        std::function<void(std::size_t)>       callback;
+        std::unique_ptr<Glib::Dispatcher>      dispatcher;
+        bool                                   finished = false;
+
+        // moves the queued chunks to `lines`
+        void drain(CommandList& lines);
+        void deliver();
+};
+
 class DMenu : public Gtk::Menu {
     public:
-        DMenu(Gtk::Window&);
+        DMenu(CommonWindow&);
         ~DMenu();
-        void emplace_back(const Glib::ustring&);
+        void emplace_back(std::string_view);
+        // updates the items after lines were appended to `all_commands` from index `from`
+        void on_commands_added(std::size_t from);
+        // marks the menu as still receiving input
+        void set_loading(bool loading);
+        // the indices of the complete `all_commands`, used from the next search on
+        void set_index(std::shared_ptr<const PrefixIndex> index, std::shared_ptr<const TrigramIndex> trigrams);
         void show_all() {
             Gtk::Menu::show_all();
             // required to have first item selected on launch
@@ -54,11 +300,20 @@ class DMenu : public Gtk::Menu {
     private:
         Gtk::SearchEntry searchbox;
         // parent window
-        Gtk::Window&     main;
+        CommonWindow&    main;
         // the first item in list
         Gtk::MenuItem*   first_item = nullptr;
         // whether case sensitivity was changed during run
         bool case_sensitivity_changed = false;
+        // matches of the search phrase, empty if there is none
+        std::optional<CommandFilter> filter;
+        std::shared_ptr<const PrefixIndex> index;
+        std::shared_ptr<const TrigramIndex> trigrams;
+        bool loading = false;
+        // pulses the search box while loading
+        sigc::connection pulse;
+        
+        void show_commands(const std::vector<std::size_t>& indices);
         
         bool on_key_press_event(GdkEventKey* event) override;
         void filter_view();
@@ -91,6 +346,18 @@ class MainWindow : public CommonWindow {
  * Function declarations
  * */
 std::vector<std::string> list_commands();
+void load_commands(CommandList&);
 std::string get_settings_path();
+std::string sort_key(std::string_view);
+void sort_commands(std::vector<std::string>&);
+std::vector<std::size_t> sort_lines(const CommandList&);
+std::vector<std::size_t> unique_lines(const CommandList&);
+std::vector<std::size_t> filter_commands(const CommandList&,
+                                         const Glib::ustring&,
+                                         bool,
+                                         int,
+                                         const History* = nullptr,
+                                         const PrefixIndex* = nullptr,
+                                         const TrigramIndex* = nullptr);
 
 void on_item_clicked(std::string);
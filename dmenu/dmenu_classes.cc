@@ -14,13 +14,15 @@
  * Re-worked for Gtkmm 3.0 by Louis Melahn, L.C. January 31, 2014.
  * */
 
+#include "alloc_stats.h"
 #include "dmenu.h"
 
 Anchor::Anchor(DMenu& menu):
     gravity_widget{Gdk::GRAVITY_CENTER}, gravity_menu{Gdk::GRAVITY_CENTER}, menu{menu}
 {
     constexpr std::array gravity { Gdk::GRAVITY_SOUTH, Gdk::GRAVITY_NORTH };
-    auto is_sway_like = wm == "sway" || wm == "i3";
+    // the menu is inside a window covering the output
+    auto is_sway_like = wm == "sway" || wm == "i3" || CommonWindow::layer_shell_supported();
     if (v_align == "t") {
         gravity_widget = gravity[is_sway_like];
         gravity_menu   = gravity[is_sway_like];
@@ -41,18 +43,25 @@ inline auto set_searchbox_placeholder = [](auto && searchbox, auto case_sensitiv
     searchbox.set_placeholder_text(placeholders[case_sensitive]);
 };
 
-inline auto build_commands_list = [](auto && dmenu, auto && commands, auto max) {
-    decltype(max) count{ 0 };
-    for (auto && command: commands) {
-        dmenu.emplace_back(command);
-        count++;
-        if (count == max) {
-            break;
+// indices of the commands shown while there is no search phrase: the ones with a history first
+static std::vector<std::size_t> first_commands() {
+    auto limit = static_cast<std::size_t>(rows);
+    auto indices = history.ranked();
+    if (indices.size() > limit) {
+        indices.resize(limit);
+    }
+    std::size_t ranked = 0;
+    for (std::size_t i = 0; i < all_commands.size() && indices.size() < limit; i++) {
+        if (ranked < history.size() && history.index(ranked) == i) {
+            ranked++;
+        } else {
+            indices.push_back(i);
         }
     }
-};
+    return indices;
+}
 
-DMenu::DMenu(Gtk::Window& main): main{main} {
+DMenu::DMenu(CommonWindow& main): main{main} {
     set_searchbox_placeholder(searchbox, case_sensitive);
     searchbox.set_sensitive(true);
     searchbox.set_name("searchbox");
@@ -64,11 +73,14 @@ DMenu::DMenu(Gtk::Window& main): main{main} {
         search_item->set_name("search_item");
         append(*search_item);
     }
-    build_commands_list(*this, all_commands, rows);
+    for (auto i : first_commands()) {
+        emplace_back(all_commands[i]);
+    }
 }
 
 DMenu::~DMenu() {
     using namespace std::string_view_literals;
+    pulse.disconnect();
     if (case_sensitivity_changed) {
         std::ofstream file{ settings_file, std::ios::trunc };
         constexpr std::array values { "case_insensitive"sv, "case_sensitive"sv };
@@ -76,7 +88,8 @@ DMenu::~DMenu() {
     }
 }
 
-void DMenu::emplace_back(const Glib::ustring& cmd) {
+void DMenu::emplace_back(std::string_view command) {
+    Glib::ustring cmd{ std::string{ command } };
     auto item = Gtk::manage(new Gtk::MenuItem{ cmd });
     item->signal_activate()
         .connect(sigc::bind<Glib::ustring>(sigc::mem_fun(*this, &DMenu::on_item_clicked), cmd));
@@ -101,6 +114,8 @@ void DMenu::fix_selection() {
 }
 
 bool DMenu::on_key_press_event(GdkEventKey* key_event) {
+    // the menu is a separate toplevel with its own frame clock
+    main.latency.begin(LatencyProbe::Keystroke, *this);
     if (show_searchbox) {
         switch (key_event->keyval) {
             case GDK_KEY_Escape:
@@ -139,6 +154,7 @@ bool DMenu::on_key_press_event(GdkEventKey* key_event) {
 }
 
 void DMenu::on_item_clicked(Glib::ustring cmd) {
+    history.record(cmd.raw());
     if (dmenu_run) {
         cmd = cmd + " &";
         const char *command = cmd.c_str();
@@ -149,70 +165,81 @@ void DMenu::on_item_clicked(Glib::ustring cmd) {
     main.close();
 }
 
+/* Replace the items, except the searchbox, with `indices` of all_commands */
+void DMenu::show_commands(const std::vector<std::size_t>& indices) {
+    this->foreach([this](auto && child) {
+        if (child.get_name() != "search_item") {
+            this->remove(child);
+        }
+    });
+    this->first_item = nullptr;
+    for (auto i : indices) {
+        emplace_back(all_commands[i]);
+    }
+    this -> show_all();
+}
+
 /* Rebuild menu to match the search phrase */
 void DMenu::filter_view() {
-    auto clear_children = [this]() {
-        this->foreach([this](auto && child) {
-            if (child.get_name() != "search_item") {
-                this->remove(child);
-            }
-        });
-        this->first_item = nullptr;
-    };
+    auto start = g_get_monotonic_time();
+    auto allocs = AllocStats::counters();
     auto search_phrase = searchbox.get_text();
     if (search_phrase.size() > 0) {
-        // remove all items except searchbox
-        clear_children();
-        int cnt = 0;
-        bool limit_exhausted = false;
-        auto sf = search_phrase;
-        if (!case_sensitive) {
-            sf = sf.uppercase();
-        }
-        for (Glib::ustring command : all_commands) {
-            auto cm = command;
-            if (!case_sensitive) {
-                cm = cm.uppercase();
-            }
-            if (cm.find(sf) == 0) {
-                emplace_back(command);
-                cnt++;
-                if (cnt == rows) {
-                    limit_exhausted = true;
-                    break;
-                }
-            }
-        }
-        if (!limit_exhausted) {
-            for (Glib::ustring command : all_commands) {
-                auto cm = command;
-                if (!case_sensitive) {
-                    cm = cm.uppercase();
-                }
-                if (cm.find(sf) != cm.npos && cm.find(sf) != 0) {
-                    emplace_back(command);
-                    cnt++;
-                    if (cnt == rows) {
-                        break;
-                    }
-                }
-            }
-        }
-        this -> show_all();
-
+        filter.emplace(search_phrase, case_sensitive, rows, &history, index.get(), trigrams.get());
+        filter->update(all_commands);
+        show_commands(filter->result());
     } else {
+        filter.reset();
         set_searchbox_placeholder(searchbox, case_sensitive);
-        // remove all items except searchbox
-        clear_children();
-        build_commands_list(*this, all_commands, rows);
-        this -> show_all();
+        show_commands(first_commands());
     }
     fix_selection();
+    main.latency.record(LatencyProbe::Filter, start);
+    AllocStats::record_filter(allocs);
+}
+
+/* Show the commands read since the menu was built, if they belong among the items */
+void DMenu::on_commands_added(std::size_t from) {
+    auto ranked = history.update(all_commands);
+    if (filter) {
+        // only the new commands are matched
+        if (filter->update(all_commands)) {
+            show_commands(filter->result());
+        }
+    } else if (ranked || from < static_cast<std::size_t>(rows)) {
+        show_commands(first_commands());
+    }
+}
+
+void DMenu::set_index(std::shared_ptr<const PrefixIndex> index_, std::shared_ptr<const TrigramIndex> trigrams_) {
+    index = std::move(index_);
+    trigrams = std::move(trigrams_);
+}
 
+void DMenu::set_loading(bool loading_) {
+    // without the search box the menu itself carries the class
+    auto style = show_searchbox ? searchbox.get_style_context() : get_style_context();
+    if (loading_ && !loading) {
+        style->add_class("loading");
+        // pulses on a timer, as the input may stall for a long time
+        if (show_searchbox) {
+            pulse = Glib::signal_timeout().connect([this]() {
+                searchbox.progress_pulse();
+                return true;
+            }, 100);
+        }
+    } else if (!loading_ && loading) {
+        style->remove_class("loading");
+        pulse.disconnect();
+        searchbox.set_progress_fraction(0.0);
+    }
+    loading = loading_;
 }
 
 MainWindow::MainWindow() : CommonWindow("~nwgdmenu", "~nwgdmenu"), menu(nullptr) {
-    if (wm == "dwm" || wm == "bspwm" || wm == "qtile" || wm == "bspwm" || wm == "tiling") {
+    if (is_layer_surface()) {
+        // covers the output already
+    } else if (wm == "dwm" || wm == "bspwm" || wm == "qtile" || wm == "bspwm" || wm == "tiling") {
         fullscreen();
     } else if (wm == "sway" || wm == "i3") {
         set_type_hint(Gdk::WINDOW_TYPE_HINT_SPLASHSCREEN);
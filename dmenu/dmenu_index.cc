@@ -0,0 +1,366 @@
+/* GTK-based dmenu
+ * Copyright (c) 2020 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "dmenu.h"
+#include "text_match.h"
+
+static unsigned char upper_ascii(char c) {
+    return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+/*
+ * Compares `a` and `b` as if their ASCII letters were upper case
+ * */
+static int compare_upper(std::string_view a, std::string_view b) {
+    auto size = std::min(a.size(), b.size());
+    for (std::size_t i = 0; i < size; i++) {
+        auto x = upper_ascii(a[i]);
+        auto y = upper_ascii(b[i]);
+        if (x != y) {
+            return x < y ? -1 : 1;
+        }
+    }
+    return a.size() < b.size() ? -1 : a.size() > b.size();
+}
+
+/*
+ * Returns the key of the line `i` in `sorted_upper`: its upper case text if it is not ASCII,
+ * otherwise the line itself, which compare_upper treats as upper case
+ * */
+std::string_view PrefixIndex::upper_key(const CommandList& commands, std::uint32_t i) const {
+    if (auto found = upper.find(i); found != upper.end()) {
+        return found->second;
+    }
+    return commands[i];
+}
+
+/* lines sorted at once between checks for cancelling */
+static constexpr std::size_t SORT_RUN = 64 * 1024;
+
+/*
+ * Sorts `order` by `less` in runs which are then merged pairwise, so that `cancelled` is checked
+ * in between; returns false, leaving `order` unsorted, once it is set
+ * */
+template <typename Less>
+static bool sort_cancellable(std::vector<std::uint32_t>& order, Less&& less, const std::atomic<bool>* cancelled) {
+    auto size = order.size();
+    auto stopped = [cancelled]() { return cancelled && *cancelled; };
+    for (std::size_t from = 0; from < size; from += SORT_RUN) {
+        if (stopped()) {
+            return false;
+        }
+        std::sort(order.begin() + from, order.begin() + std::min(from + SORT_RUN, size), less);
+    }
+    for (std::size_t run = SORT_RUN; run < size; run *= 2) {
+        for (std::size_t from = 0; from + run < size; from += 2 * run) {
+            if (stopped()) {
+                return false;
+            }
+            auto begin = order.begin() + from;
+            std::inplace_merge(begin, begin + run, order.begin() + std::min(from + 2 * run, size), less);
+        }
+    }
+    return true;
+}
+
+PrefixIndex::PrefixIndex(const CommandList& commands, const std::atomic<bool>* cancelled) {
+    auto size = commands.size();
+    std::vector<std::string_view> keys(size);
+    for (std::size_t i = 0; i < size; i++) {
+        if (cancelled && i % 4096 == 0 && *cancelled) {
+            return;
+        }
+        auto line = commands[i];
+        if (is_ascii(line)) {
+            keys[i] = line;
+        } else {
+            // the way CommandFilter matches them
+            keys[i] = upper[i] = Glib::ustring{ std::string{ line } }.uppercase().raw();
+        }
+    }
+    sorted.resize(size);
+    for (std::size_t i = 0; i < size; i++) {
+        sorted[i] = static_cast<std::uint32_t>(i);
+    }
+    sorted_upper = sorted;
+    auto by_text = [&commands](auto a, auto b) {
+        auto cmp = commands[a].compare(commands[b]);
+        return cmp < 0 || (cmp == 0 && a < b);
+    };
+    auto by_upper = [&keys](auto a, auto b) {
+        auto cmp = compare_upper(keys[a], keys[b]);
+        return cmp < 0 || (cmp == 0 && a < b);
+    };
+    // an unfinished index covers no lines
+    if (!sort_cancellable(sorted, by_text, cancelled) || !sort_cancellable(sorted_upper, by_upper, cancelled)) {
+        sorted.clear();
+        sorted_upper.clear();
+        return;
+    }
+    position.resize(size);
+    position_upper.resize(size);
+    for (std::size_t p = 0; p < size; p++) {
+        position[sorted[p]] = static_cast<std::uint32_t>(p);
+        position_upper[sorted_upper[p]] = static_cast<std::uint32_t>(p);
+    }
+}
+
+std::size_t PrefixIndex::starting_with(const CommandList& commands,
+                                       std::string_view phrase,
+                                       bool case_sensitive,
+                                       std::size_t limit,
+                                       std::vector<std::size_t>& result) const {
+    // the lines starting with the phrase are adjacent in the sorted order
+    auto& order = case_sensitive ? sorted : sorted_upper;
+    auto compare = [&, case_sensitive](std::uint32_t i) {
+        if (case_sensitive) {
+            return commands[i].substr(0, phrase.size()).compare(phrase);
+        }
+        return compare_upper(upper_key(commands, i).substr(0, phrase.size()), phrase);
+    };
+    auto from = std::lower_bound(order.begin(), order.end(), phrase, [&compare](auto i, auto&) {
+        return compare(i) < 0;
+    });
+    auto to = std::upper_bound(from, order.end(), phrase, [&compare](auto&, auto i) {
+        return compare(i) > 0;
+    });
+    // the first `limit` of them in the list
+    std::size_t count = to - from;
+    if (count > limit && limit * sorted.size() / count < count) {
+        // many lines match: walking the list finds `limit` of them before taking all of the range would
+        auto& positions = case_sensitive ? position : position_upper;
+        std::uint32_t first = from - order.begin();
+        std::uint32_t last = to - order.begin();
+        std::size_t taken = 0;
+        for (std::size_t i = 0; i < positions.size() && taken < limit; i++) {
+            if (positions[i] >= first && positions[i] < last) {
+                result.push_back(i);
+                taken++;
+            }
+        }
+        return count;
+    }
+    std::vector<std::uint32_t> found(from, to);
+    if (found.size() > limit) {
+        std::nth_element(found.begin(), found.begin() + limit, found.end());
+        found.resize(limit);
+    }
+    std::sort(found.begin(), found.end());
+    result.insert(result.end(), found.begin(), found.end());
+    return count;
+}
+
+/*
+ * Bucket of the trigram `a`, `b`, `c`; buckets are shared by a few trigrams,
+ * which only adds candidates to verify
+ * */
+static std::uint32_t trigram_bucket(unsigned char a, unsigned char b, unsigned char c, unsigned bits) {
+    std::uint32_t trigram = a << 16 | b << 8 | c;
+    return (trigram * 2654435761u) >> (32 - bits);
+}
+
+/*
+ * Calls `fn` with the distinct buckets of the trigrams of the upper case `line`
+ * */
+template <typename F>
+static void for_each_bucket(std::string_view line, unsigned bits, std::vector<std::uint32_t>& buckets, F&& fn) {
+    buckets.clear();
+    for (std::size_t i = 2; i < line.size(); i++) {
+        auto a = upper_ascii(line[i - 2]);
+        auto b = upper_ascii(line[i - 1]);
+        buckets.push_back(trigram_bucket(a, b, upper_ascii(line[i]), bits));
+    }
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+    for (auto bucket : buckets) {
+        fn(bucket);
+    }
+}
+
+static std::size_t varint_size(std::uint32_t value) {
+    std::size_t size = 1;
+    for (; value >= 0x80; value >>= 7) {
+        size++;
+    }
+    return size;
+}
+
+TrigramIndex::TrigramIndex(const CommandList& commands, const std::atomic<bool>* cancelled):
+    lines{ commands.size() }
+{
+    // about as many buckets as lines, up to a million
+    bits = 10;
+    while (bits < 20 && std::size_t{ 1 } << bits < lines) {
+        bits++;
+    }
+    auto buckets_count = std::size_t{ 1 } << bits;
+    offsets.resize(buckets_count + 1, 0);
+    // the upper case text of the non-ASCII lines, the way CommandFilter matches them
+    std::unordered_map<std::uint32_t, std::string> upper;
+    auto key = [&commands, &upper](std::uint32_t i) -> std::string_view {
+        if (auto found = upper.find(i); found != upper.end()) {
+            return found->second;
+        }
+        return commands[i];
+    };
+    // an unfinished index covers no lines
+    auto is_cancelled = [this, cancelled](std::uint32_t i) {
+        if (cancelled && i % 4096 == 0 && *cancelled) {
+            lines = 0;
+            return true;
+        }
+        return false;
+    };
+    // sizes of the posting lists first, then the lists themselves
+    std::vector<std::uint32_t> last(buckets_count, 0);
+    std::vector<std::uint32_t> buckets;
+    for (std::uint32_t i = 0; i < lines; i++) {
+        if (is_cancelled(i)) {
+            return;
+        }
+        auto line = commands[i];
+        if (!is_ascii(line)) {
+            line = upper[i] = Glib::ustring{ std::string{ line } }.uppercase().raw();
+        }
+        for_each_bucket(line, bits, buckets, [&](auto bucket) {
+            offsets[bucket + 1] += varint_size(i - last[bucket]);
+            last[bucket] = i;
+        });
+    }
+    for (std::size_t bucket = 0; bucket < buckets_count; bucket++) {
+        offsets[bucket + 1] += offsets[bucket];
+    }
+    postings.resize(offsets.back());
+    std::fill(last.begin(), last.end(), 0);
+    std::vector<std::size_t> ends(offsets.begin(), offsets.end() - 1);
+    for (std::uint32_t i = 0; i < lines; i++) {
+        if (is_cancelled(i)) {
+            return;
+        }
+        for_each_bucket(key(i), bits, buckets, [&](auto bucket) {
+            auto delta = i - last[bucket];
+            auto& end = ends[bucket];
+            for (; delta >= 0x80; delta >>= 7) {
+                postings[end++] = static_cast<std::uint8_t>(delta | 0x80);
+            }
+            postings[end++] = static_cast<std::uint8_t>(delta);
+            last[bucket] = i;
+        });
+    }
+}
+
+/*
+ * Reads the line indices of a delta encoded posting list
+ * */
+class TrigramIndex::Postings {
+    public:
+        Postings(const std::uint8_t* from, const std::uint8_t* to): from{ from }, to{ to } { }
+
+        bool next(std::uint32_t& line) {
+            if (from == to) {
+                return false;
+            }
+            std::uint32_t delta = 0;
+            for (unsigned shift = 0;; shift += 7) {
+                auto byte = *from++;
+                delta |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    break;
+                }
+            }
+            line = value += delta;
+            return true;
+        }
+    private:
+        const std::uint8_t* from;
+        const std::uint8_t* to;
+        std::uint32_t       value = 0;
+};
+
+bool TrigramIndex::candidates(std::string_view phrase,
+                              bool case_sensitive,
+                              const std::function<bool(std::size_t)>& fn) const {
+    // case sensitive non-ASCII phrases are not folded the way the lines are
+    if (phrase.size() < 3 || (case_sensitive && !is_ascii(phrase))) {
+        return false;
+    }
+    std::vector<std::uint32_t> buckets;
+    for_each_bucket(phrase, bits, buckets, [](auto) { });
+    // the shortest list leads, the others are only read up to its lines
+    auto size = [this](auto bucket) { return offsets[bucket + 1] - offsets[bucket]; };
+    std::sort(buckets.begin(), buckets.end(), [&size](auto a, auto b) { return size(a) < size(b); });
+    std::vector<Postings> lists;
+    for (auto bucket : buckets) {
+        lists.emplace_back(postings.data() + offsets[bucket], postings.data() + offsets[bucket + 1]);
+    }
+    // the current line of each of the others, no line is past the end of one of them
+    std::vector<std::uint32_t> heads(lists.size());
+    for (std::size_t i = 1; i < lists.size(); i++) {
+        if (!lists[i].next(heads[i])) {
+            return true;
+        }
+    }
+    for (std::uint32_t line; lists[0].next(line);) {
+        bool found = true;
+        for (std::size_t i = 1; i < lists.size() && found; i++) {
+            while (heads[i] < line) {
+                if (!lists[i].next(heads[i])) {
+                    return true;
+                }
+            }
+            found = heads[i] == line;
+        }
+        if (found && !fn(line)) {
+            break;
+        }
+    }
+    return true;
+}
+
+IndexBuilder::IndexBuilder(const CommandList& commands, Callback callback):
+    callback{ std::move(callback) }
+{
+    dispatcher.connect([this]() {
+        std::shared_ptr<const PrefixIndex> prefix;
+        std::shared_ptr<const TrigramIndex> trigram;
+        {
+            std::lock_guard lock{ mutex };
+            prefix = index;
+            trigram = trigrams;
+        }
+        this->callback(std::move(prefix), std::move(trigram));
+    });
+    // the prefix index is quick to build, it is handed over first
+    thread = std::thread([this, &commands]() {
+        auto prefix = std::make_shared<const PrefixIndex>(commands, &cancelled);
+        if (cancelled) {
+            return;
+        }
+        {
+            std::lock_guard lock{ mutex };
+            index = std::move(prefix);
+        }
+        dispatcher.emit();
+        auto trigram = std::make_shared<const TrigramIndex>(commands, &cancelled);
+        if (!cancelled) {
+            {
+                std::lock_guard lock{ mutex };
+                trigrams = std::move(trigram);
+            }
+            dispatcher.emit();
+        }
+    });
+}
+
+IndexBuilder::~IndexBuilder() {
+    cancelled = true;
+    thread.join();
+}
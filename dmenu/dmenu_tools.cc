@@ -6,7 +6,27 @@
  * License: GPL3
  * */
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <clocale>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
 #include "nwg_tools.h"
+#include "spsc_queue.h"
+#include "text_match.h"
 #include "dmenu.h"
 
 /*
@@ -30,24 +50,842 @@ std::string get_settings_path() {
 }
 
 /*
- * Returns all command paths
+ * Returns the directories of $PATH in order, without repetitions
+ * */
+static std::vector<std::string> path_dirs(std::string_view path) {
+    std::vector<std::string> dirs;
+    for (auto dir : split_string(path, ":")) {
+        if (!dir.empty() && std::find(dirs.begin(), dirs.end(), dir) == dirs.end()) {
+            dirs.emplace_back(dir);
+        }
+    }
+    return dirs;
+}
+
+/*
+ * Returns the names of the executables in `dir`, except hidden and one-letter ones
+ * */
+static std::vector<std::string> list_executables(const std::string& dir) {
+    std::vector<std::string> names;
+    auto stream = opendir(dir.c_str());
+    if (!stream) {
+        return names;
+    }
+    auto dir_fd = dirfd(stream);
+    while (auto dirent = readdir(stream)) {
+        std::string_view name = dirent->d_name;
+        if (name[0] == '.' || name.size() == 1) {
+            continue;
+        }
+        auto type = dirent->d_type;
+        if (type == DT_LNK || type == DT_UNKNOWN) {
+            struct stat st;
+            type = fstatat(dir_fd, dirent->d_name, &st, 0) == 0 && S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type == DT_REG && faccessat(dir_fd, dirent->d_name, X_OK, 0) == 0) {
+            names.emplace_back(name);
+        }
+    }
+    closedir(stream);
+    return names;
+}
+
+/*
+ * Returns the sorted names of the commands in `dirs`, listed in parallel on ThreadPool::shared()
+ * */
+static std::vector<std::string> list_commands(const std::vector<std::string>& dirs) {
+    std::vector<std::vector<std::string>> listed(dirs.size());
+    ThreadPool::shared().run(dirs.size(), [&dirs, &listed](std::size_t i) {
+        listed[i] = list_executables(dirs[i]);
+    });
+    // a command found in several directories is the one of the first of them
+    std::vector<std::string> commands;
+    std::unordered_set<std::string_view> seen;
+    for (auto& names : listed) {
+        for (auto& name : names) {
+            if (seen.insert(name).second) {
+                commands.push_back(name);
+            }
+        }
+    }
+    sort_commands(commands);
+    return commands;
+}
+
+/*
+ * Returns the sorted names of the commands in $PATH
  * */
 std::vector<std::string> list_commands() {
-    std::vector<std::string> command_paths;
-
-    if (auto command_dirs = getenv("PATH"); command_dirs) {
-        auto paths = split_string(command_dirs, ":");
-        std::error_code ec;
-        for (auto& dir : paths) {
-            // if directory exists
-            if (fs::is_directory(dir, ec) && !ec) {
-                for (const auto & entry : fs::directory_iterator(dir)) {
-                    command_paths.emplace_back(entry.path());
+    auto path = getenv("PATH");
+    return list_commands(path_dirs(path ? path : ""));
+}
+
+static std::int64_t mtime_ns(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return 0;
+    }
+    return std::int64_t{ st.st_mtim.tv_sec } * 1'000'000'000 + st.st_mtim.tv_nsec;
+}
+
+/*
+ * Reads the commands saved by `save_commands` to `commands` if they were listed
+ * from the same $PATH, with its directories at the same `mtimes`, and sorted
+ * in the same `collate` locale
+ * */
+static bool load_commands(const fs::path& file,
+                          std::string_view path,
+                          std::string_view collate,
+                          const std::vector<std::int64_t>& mtimes,
+                          CommandList& commands) {
+    auto contents = read_file_to_string(file);
+    std::string_view view = contents;
+    auto next_line = [&view]() {
+        auto eol = view.find('\n');
+        auto line = view.substr(0, eol);
+        view.remove_prefix(eol == view.npos ? view.size() : eol + 1);
+        return line;
+    };
+    if (next_line() != "nwg-path-index 2" || next_line() != path || next_line() != collate) {
+        return false;
+    }
+    for (auto expected : mtimes) {
+        auto line = next_line();
+        std::int64_t mtime = -1;
+        auto [end, ec] = std::from_chars(line.data(), line.data() + line.size(), mtime);
+        if (ec != std::errc() || mtime != expected) {
+            return false;
+        }
+    }
+    // a complete file ends with a newline
+    if (!view.empty() && view.back() != '\n') {
+        return false;
+    }
+    commands.append(view);
+    return true;
+}
+
+/*
+ * Saves the commands found in the directories `dirs` of `path` along with their `mtimes`
+ * and the `collate` locale they are sorted in
+ * */
+static void save_commands(const fs::path& file,
+                          std::string_view path,
+                          std::string_view collate,
+                          const std::vector<std::string>& dirs,
+                          const std::vector<std::int64_t>& mtimes,
+                          const std::vector<std::string>& names) {
+    std::string contents = "nwg-path-index 2\n";
+    contents.append(path).append(1, '\n');
+    contents.append(collate).append(1, '\n');
+    for (std::size_t i = 0; i < dirs.size(); i++) {
+        contents += std::to_string(mtimes[i]) + ' ' + dirs[i] + '\n';
+    }
+    for (auto& name : names) {
+        contents.append(name).append(1, '\n');
+    }
+    std::error_code ec;
+    fs::create_directories(file.parent_path(), ec);
+    auto tmp = file;
+    tmp += ".tmp";
+    save_string_to_file(contents, tmp);
+    fs::rename(tmp, file, ec);
+}
+
+/*
+ * Fills `commands` with the sorted names of the commands in $PATH, from the cache
+ * in `nwg-path-index` when $PATH and its directories did not change
+ * */
+void load_commands(CommandList& commands) {
+    auto env = getenv("PATH");
+    std::string_view path = env ? env : "";
+    auto file = get_cache_home() / "nwg-path-index";
+    // the order of the sort keys, see `sort_key`
+    std::string_view collate = setlocale(LC_COLLATE, nullptr);
+    auto dirs = path_dirs(path);
+    // taken before listing, so that a change during it is seen next time
+    std::vector<std::int64_t> mtimes;
+    for (auto& dir : dirs) {
+        mtimes.push_back(mtime_ns(dir));
+    }
+    if (load_commands(file, path, collate, mtimes, commands)) {
+        return;
+    }
+    auto names = list_commands(dirs);
+    save_commands(file, path, collate, dirs, mtimes, names);
+    for (auto& name : names) {
+        commands.push_back(name);
+    }
+}
+
+/* lists shorter than that are sorted on one thread */
+static constexpr std::size_t PARALLEL_SORT_MIN = 32 * 1024;
+
+/*
+ * Returns the key ordering `command` case insensitive in the current locale:
+ * the collation key of its case folded text, or the bytes if it is not valid UTF-8
+ * */
+std::string sort_key(std::string_view command) {
+    std::string text{ command };
+    if (std::none_of(text.begin(), text.end(), [](char c) { return c & 0x80; })) {
+        // ASCII folds to lower case
+        for (auto& c : text) {
+            c = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+        }
+        return Glib::ustring{ std::move(text) }.collate_key();
+    }
+    Glib::ustring utf8{ std::move(text) };
+    if (!utf8.validate()) {
+        return utf8.raw();
+    }
+    return utf8.casefold().collate_key();
+}
+
+/*
+ * Calls `fn(from, to)` for `size` items split between the threads of ThreadPool::shared()
+ * when there are many of them
+ * */
+template <typename F>
+static void split_work(std::size_t size, F&& fn) {
+    auto& pool = ThreadPool::shared();
+    std::size_t parts = size < PARALLEL_SORT_MIN ? 1 : pool.size();
+    pool.run(parts, [size, parts, &fn](std::size_t t) {
+        fn(size * t / parts, size * (t + 1) / parts);
+    });
+}
+
+/*
+ * Returns the order of the `size` items sorted by `key(i)`, equal keys in their original order.
+ * The keys are computed once, both they and the sort are split between threads for long lists
+ * */
+template <typename Key>
+static std::vector<std::size_t> sort_order(std::size_t size, Key&& key) {
+    std::vector<std::string> keys(size);
+    split_work(size, [&keys, &key](std::size_t from, std::size_t to) {
+        for (auto i = from; i < to; i++) {
+            keys[i] = key(i);
+        }
+    });
+    std::vector<std::size_t> order(size);
+    for (std::size_t i = 0; i < size; i++) {
+        order[i] = i;
+    }
+    auto less = [&keys](std::size_t a, std::size_t b) {
+        auto cmp = keys[a].compare(keys[b]);
+        return cmp < 0 || (cmp == 0 && a < b);
+    };
+    // sorted runs, then merged pairwise
+    std::vector<std::size_t> runs;
+    std::mutex mutex;
+    split_work(size, [&order, &less, &runs, &mutex](std::size_t from, std::size_t to) {
+        std::sort(order.begin() + from, order.begin() + to, less);
+        std::lock_guard lock{ mutex };
+        runs.push_back(to);
+    });
+    std::sort(runs.begin(), runs.end());
+    runs.insert(runs.begin(), 0);
+    while (runs.size() > 2) {
+        std::vector<std::size_t> merged{ 0 };
+        for (std::size_t r = 2; r < runs.size(); r += 2) {
+            std::inplace_merge(order.begin() + runs[r - 2], order.begin() + runs[r - 1], order.begin() + runs[r], less);
+            merged.push_back(runs[r]);
+        }
+        if (runs.size() % 2 == 0) {
+            merged.push_back(runs.back());
+        }
+        runs = std::move(merged);
+    }
+    return order;
+}
+
+/*
+ * Sorts commands case insensitive, see `sort_key`
+ * */
+void sort_commands(std::vector<std::string>& commands) {
+    auto order = sort_order(commands.size(), [&commands](std::size_t i) { return sort_key(commands[i]); });
+    std::vector<std::string> sorted;
+    sorted.reserve(commands.size());
+    for (auto i : order) {
+        sorted.push_back(std::move(commands[i]));
+    }
+    commands = std::move(sorted);
+}
+
+/*
+ * Returns the order of the lines of `commands` sorted case insensitive, see `sort_key`
+ * */
+std::vector<std::size_t> sort_lines(const CommandList& commands) {
+    return sort_order(commands.size(), [&commands](std::size_t i) { return sort_key(commands[i]); });
+}
+
+/*
+ * Returns the indices of the first occurrences of the lines of `commands`
+ * */
+std::vector<std::size_t> unique_lines(const CommandList& commands) {
+    // open addressing set of line indices, nothing is allocated per line
+    constexpr auto EMPTY = std::numeric_limits<std::size_t>::max();
+    std::size_t capacity = 16;
+    while (capacity < commands.size() * 2) {
+        capacity *= 2;
+    }
+    std::vector<std::size_t> seen(capacity, EMPTY);
+    std::vector<std::size_t> unique;
+    std::hash<std::string_view> hash;
+    for (std::size_t i = 0; i < commands.size(); i++) {
+        auto line = commands[i];
+        for (auto slot = hash(line) & (capacity - 1);; slot = (slot + 1) & (capacity - 1)) {
+            if (seen[slot] == EMPTY) {
+                seen[slot] = i;
+                unique.push_back(i);
+                break;
+            }
+            if (commands[seen[slot]] == line) {
+                break;
+            }
+        }
+    }
+    return unique;
+}
+
+CommandList::~CommandList() {
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+/*
+ * Adds the starts of the lines ending in data[from, to)
+ * */
+void CommandList::index(std::size_t from, std::size_t to) {
+    while (from < to) {
+        auto eol = static_cast<const char*>(std::memchr(data + from, '\n', to - from));
+        if (!eol) {
+            // the last line of a file without the final '\n'
+            starts.push_back(to + 1);
+            return;
+        }
+        from = eol - data + 1;
+        starts.push_back(from);
+    }
+}
+
+void CommandList::select(const std::vector<std::size_t>& indices) {
+    std::size_t size = 0;
+    for (auto i : indices) {
+        size += starts[i + 1] - starts[i];
+    }
+    std::vector<char> selected;
+    selected.reserve(size);
+    std::vector<std::size_t> selected_starts{ 0 };
+    selected_starts.reserve(indices.size() + 1);
+    for (auto i : indices) {
+        auto line = (*this)[i];
+        selected.insert(selected.end(), line.begin(), line.end());
+        selected.push_back('\n');
+        selected_starts.push_back(selected.size());
+    }
+    if (mapping) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+    }
+    buffer = std::move(selected);
+    starts = std::move(selected_starts);
+    data = buffer.data();
+}
+
+void CommandList::push_back(std::string_view line) {
+    buffer.insert(buffer.end(), line.begin(), line.end());
+    buffer.push_back('\n');
+    data = buffer.data();
+    starts.push_back(buffer.size());
+}
+
+void CommandList::append(std::string_view text) {
+    auto from = buffer.size();
+    buffer.insert(buffer.end(), text.begin(), text.end());
+    data = buffer.data();
+    index(from, buffer.size());
+}
+
+bool CommandList::map(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    // the file may have been partially read already
+    auto offset = lseek(fd, 0, SEEK_CUR);
+    if (offset < 0 || offset >= st.st_size) {
+        return offset >= 0;
+    }
+    auto size = static_cast<std::size_t>(st.st_size);
+    auto address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    // every line is visited by the first search
+    madvise(address, size, MADV_WILLNEED);
+    mapping = address;
+    mapping_size = size;
+    data = static_cast<const char*>(address) + offset;
+    index(0, size - offset);
+    return true;
+}
+
+/* half-life of the weight of a selection */
+static constexpr std::int64_t HISTORY_HALF_LIFE = 7 * 24 * 60 * 60;
+/* number of lines after which the history file is rewritten */
+static constexpr std::size_t HISTORY_COMPACT_AFTER = 256;
+/* weights are saved in thousandths */
+static constexpr double HISTORY_UNIT = 1000.0;
+
+static std::int64_t now_s() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Weight of a selection made at `time` with `weight`, as of `now`
+ * */
+static double decayed(double weight, std::int64_t time, std::int64_t now) {
+    return weight * std::exp2(-static_cast<double>(std::max<std::int64_t>(now - time, 0)) / HISTORY_HALF_LIFE);
+}
+
+/*
+ * Lines of the history file are `<time> <weight in thousandths> <command>`
+ * */
+void History::load(std::string_view source) {
+    std::string name{ source };
+    std::replace(name.begin(), name.end(), '/', '%');
+    file = get_cache_home() / "nwg-dmenu-history" / name;
+    contents = read_file_to_string(file);
+    auto now = now_s();
+    std::string_view view = contents;
+    while (!view.empty()) {
+        auto eol = view.find('\n');
+        auto line = view.substr(0, eol);
+        view.remove_prefix(eol == view.npos ? view.size() : eol + 1);
+        records++;
+        std::int64_t time = 0, weight = 0;
+        auto end = line.data() + line.size();
+        auto [p, ec] = std::from_chars(line.data(), end, time);
+        if (ec != std::errc() || p == end || *p != ' ') {
+            continue;
+        }
+        auto [q, ec2] = std::from_chars(p + 1, end, weight);
+        if (ec2 != std::errc() || q == end || *q != ' ' || q + 1 == end) {
+            continue;
+        }
+        std::string_view command{ q + 1, static_cast<std::size_t>(end - q - 1) };
+        entries[command].score += decayed(weight / HISTORY_UNIT, time, now);
+    }
+}
+
+bool History::update(const CommandList& commands) {
+    auto from = found.size();
+    for (; scanned < commands.size() && !entries.empty(); scanned++) {
+        if (auto entry = entries.find(commands[scanned]); entry != entries.end() && !entry->second.found) {
+            entry->second.found = true;
+            found.push_back({ scanned, entry->second.score });
+        }
+    }
+    scanned = commands.size();
+    return found.size() != from;
+}
+
+std::vector<std::size_t> History::ranked() const {
+    auto sorted = found;
+    std::stable_sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) { return a.score > b.score; });
+    std::vector<std::size_t> result;
+    result.reserve(sorted.size());
+    for (auto& f : sorted) {
+        result.push_back(f.index);
+    }
+    return result;
+}
+
+void History::record(std::string_view command) {
+    if (file.empty()) {
+        return;
+    }
+    auto now = now_s();
+    std::error_code ec;
+    fs::create_directories(file.parent_path(), ec);
+    if (records + 1 < HISTORY_COMPACT_AFTER) {
+        std::ofstream{ file, std::ios::app } << now << ' ' << static_cast<std::int64_t>(HISTORY_UNIT) << ' ' << command << '\n';
+        return;
+    }
+    // one line per command, with the weight as of now; the forgotten ones are dropped
+    entries[command].score += 1.0;
+    std::string compacted;
+    for (auto& [name, entry] : entries) {
+        auto weight = static_cast<std::int64_t>(entry.score * HISTORY_UNIT);
+        if (weight > 0) {
+            compacted.append(std::to_string(now)).append(1, ' ').append(std::to_string(weight)).append(1, ' ')
+                     .append(name).append(1, '\n');
+        }
+    }
+    auto tmp = file;
+    tmp += ".tmp";
+    save_string_to_file(compacted, tmp);
+    fs::rename(tmp, file, ec);
+}
+
+CommandFilter::CommandFilter(const Glib::ustring& phrase,
+                             bool case_sensitive,
+                             int limit,
+                             const History* history,
+                             const PrefixIndex* index,
+                             const TrigramIndex* trigrams):
+    phrase{ case_sensitive ? phrase : phrase.uppercase() },
+    case_sensitive{ case_sensitive },
+    limit{ static_cast<std::size_t>(limit) },
+    history{ history },
+    index{ index },
+    trigrams{ trigrams } { }
+
+/*
+ * Position of the upper case `phrase` in `command`, ignoring case, or npos.
+ * ASCII commands are compared in place, the others are converted by Glib
+ * */
+static std::size_t find_ignoring_case(std::string_view command, const Glib::ustring& phrase) {
+    if (!is_ascii(command)) {
+        return Glib::ustring{ std::string{ command } }.uppercase().find(phrase);
+    }
+    return find_ascii_nocase(command, phrase.raw());
+}
+
+std::size_t CommandFilter::find(std::string_view command) const {
+    return case_sensitive ? command.find(phrase.raw()) : find_ignoring_case(command, phrase);
+}
+
+std::size_t CommandFilter::count() const {
+    return ranked_prefix.size() + prefix.size() + ranked_infix.size() + infix.size();
+}
+
+bool CommandFilter::is_ranked(std::size_t i) const {
+    std::size_t from = 0;
+    std::size_t to = history ? history->size() : 0;
+    while (from < to) {
+        auto middle = from + (to - from) / 2;
+        if (history->index(middle) < i) {
+            from = middle + 1;
+        } else {
+            to = middle;
+        }
+    }
+    return history && from < history->size() && history->index(from) == i;
+}
+
+/*
+ * Takes the prefix matches from the index, then looks for the other matches only until there are enough:
+ * among the candidates of the trigram index if there is one, otherwise in all the commands
+ * */
+void CommandFilter::update_indexed(const CommandList& commands) {
+    auto ranked = history ? history->size() : 0;
+    auto needed = limit > ranked_prefix.size() ? limit - ranked_prefix.size() : 0;
+    // some of them may be ranked already
+    auto wanted = needed > std::numeric_limits<std::size_t>::max() - ranked ? needed : needed + ranked;
+    std::vector<std::size_t> found;
+    index->starting_with(commands, phrase.raw(), case_sensitive, wanted, found);
+    for (auto i = found.begin(); i != found.end() && prefix.size() < needed; ++i) {
+        if (!is_ranked(*i)) {
+            prefix.push_back(*i);
+        }
+    }
+    auto add_infix = [this, &commands](std::size_t i) {
+        if (!is_ranked(i)) {
+            if (auto pos = find(commands[i]); pos != 0 && pos != Glib::ustring::npos) {
+                infix.push_back(i);
+            }
+        }
+    };
+    auto add_candidate = [this, &add_infix](std::size_t i) {
+        add_infix(i);
+        return count() < limit;
+    };
+    if (count() >= limit) {
+        // the prefix matches are enough
+    } else if (trigrams && trigrams->size() == commands.size()
+               && trigrams->candidates(phrase.raw(), case_sensitive, add_candidate)) {
+        // the candidates were verified
+    } else {
+        for (; scanned < commands.size() && count() < limit; scanned++) {
+            add_infix(scanned);
+        }
+    }
+    scanned = commands.size();
+}
+
+/* lists shorter than that are filtered on one thread */
+static constexpr std::size_t PARALLEL_FILTER_MIN = 64 * 1024;
+static constexpr std::size_t FILTER_CHUNK = 16 * 1024;
+
+/*
+ * Scans the commands added since the last update in chunks, split between the threads of the pool.
+ * Each chunk keeps its own first matches, which are then added chunk after chunk the way a scan
+ * on one thread adds them; the chunks after the ones holding enough prefix matches are skipped
+ * */
+bool CommandFilter::scan_parallel(const CommandList& commands) {
+    struct Chunk {
+        std::size_t              from;
+        std::size_t              to;
+        std::vector<std::size_t> prefix;
+        std::vector<std::size_t> infix;
+        bool                     done = false;
+    };
+    std::vector<Chunk> chunks;
+    for (auto from = scanned; from < commands.size(); from += FILTER_CHUNK) {
+        chunks.push_back({ from, std::min(from + FILTER_CHUNK, commands.size()) });
+    }
+    auto needed = limit - ranked_prefix.size() - prefix.size();
+    std::atomic<std::size_t> stop{ chunks.size() };  // the chunks from there on are not needed
+    std::mutex mutex;
+    std::size_t complete = 0;  // chunks done, up to the first one which is not
+    std::size_t found = 0;     // prefix matches in them
+    auto& threads = pool ? *pool : ThreadPool::shared();
+    threads.run(chunks.size(), [&](std::size_t c) {
+        auto& chunk = chunks[c];
+        for (auto i = chunk.from; i < chunk.to && chunk.prefix.size() < needed; i++) {
+            if ((i - chunk.from) % 1024 == 0 && c >= stop.load(std::memory_order_relaxed)) {
+                return;
+            }
+            if (is_ranked(i)) {
+                continue;
+            }
+            auto pos = find(commands[i]);
+            if (pos == 0) {
+                chunk.prefix.push_back(i);
+            } else if (pos != Glib::ustring::npos && chunk.infix.size() < limit) {
+                chunk.infix.push_back(i);
+            }
+        }
+        std::lock_guard lock{ mutex };
+        chunk.done = true;
+        for (; complete < chunks.size() && chunks[complete].done && found < needed; complete++) {
+            found += chunks[complete].prefix.size();
+        }
+        if (found >= needed) {
+            stop = complete;
+        }
+    });
+    bool changed = false;
+    for (std::size_t c = 0; c < stop; c++) {
+        auto& chunk = chunks[c];
+        // both kinds of matches in the order of the commands
+        auto p = chunk.prefix.begin();
+        auto n = chunk.infix.begin();
+        while (p != chunk.prefix.end() || n != chunk.infix.end()) {
+            if (n == chunk.infix.end() || (p != chunk.prefix.end() && *p < *n)) {
+                prefix.push_back(*p);
+                changed = true;
+                if (ranked_prefix.size() + prefix.size() >= limit) {
+                    scanned = *p + 1;
+                    return true;
+                }
+                ++p;
+            } else {
+                if (count() < limit) {
+                    infix.push_back(*n);
+                    changed = true;
                 }
+                ++n;
+            }
+        }
+        scanned = chunk.to;
+    }
+    return changed;
+}
+
+bool CommandFilter::update(const CommandList& commands) {
+    bool changed = false;
+    // the commands with a history are few, they are all matched wherever they are
+    for (; history && ranked_scanned < history->size(); ranked_scanned++) {
+        auto i = history->index(ranked_scanned);
+        auto pos = find(commands[i]);
+        if (pos == 0) {
+            ranked_prefix.emplace_back(history->score(ranked_scanned), i);
+            changed = true;
+        } else if (pos != Glib::ustring::npos) {
+            ranked_infix.emplace_back(history->score(ranked_scanned), i);
+            changed = true;
+        }
+    }
+    if (index && scanned == 0 && index->size() == commands.size()) {
+        update_indexed(commands);
+        return changed || !prefix.empty() || !infix.empty();
+    }
+    if (commands.size() - scanned >= PARALLEL_FILTER_MIN && ranked_prefix.size() + prefix.size() < limit) {
+        changed = scan_parallel(commands) || changed;
+    }
+    // once there are `limit` prefix matches, no later command can change the result
+    for (; scanned < commands.size() && ranked_prefix.size() + prefix.size() < limit; scanned++) {
+        if (history) {
+            while (ranked_skipped < history->size() && history->index(ranked_skipped) < scanned) {
+                ranked_skipped++;
             }
+            if (ranked_skipped < history->size() && history->index(ranked_skipped) == scanned) {
+                continue;
+            }
+        }
+        auto pos = find(commands[scanned]);
+        if (pos == 0) {
+            prefix.push_back(scanned);
+            changed = true;
+        } else if (pos != Glib::ustring::npos && count() < limit) {
+            infix.push_back(scanned);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+std::vector<std::size_t> CommandFilter::result() const {
+    std::vector<std::size_t> result;
+    result.reserve(std::min(limit, count()));
+    auto add = [&result, this](auto& indices) {
+        for (auto i = indices.begin(); i != indices.end() && result.size() != limit; ++i) {
+            result.push_back(*i);
+        }
+    };
+    auto add_ranked = [&add](auto ranked) {
+        std::stable_sort(ranked.begin(), ranked.end(), [](auto& a, auto& b) { return a.first > b.first; });
+        std::vector<std::size_t> indices;
+        for (auto& r : ranked) {
+            indices.push_back(r.second);
         }
+        add(indices);
+    };
+    add_ranked(ranked_prefix);
+    add(prefix);
+    add_ranked(ranked_infix);
+    add(infix);
+    return result;
+}
+
+/*
+ * Returns indices of up to `limit` commands containing `phrase`,
+ * the ones starting with it go first; negative `limit` means no limit
+ * */
+std::vector<std::size_t> filter_commands(const CommandList& commands,
+                                         const Glib::ustring& phrase,
+                                         bool case_sensitive,
+                                         int limit,
+                                         const History* history,
+                                         const PrefixIndex* index,
+                                         const TrigramIndex* trigrams) {
+    CommandFilter filter{ phrase, case_sensitive, limit, history, index, trigrams };
+    filter.update(commands);
+    return filter.result();
+}
+
+struct StdinReader::State {
+    SpscQueue<std::string, 64>                queue;              // complete lines
+    std::atomic<bool>                         eof{ false };
+    std::atomic<bool>                         notified{ false };  // a delivery is pending
+    std::mutex                                mutex;              // guards `dispatcher`
+    Glib::Dispatcher*                         dispatcher = nullptr;
+
+    void notify() {
+        if (!notified.exchange(true)) {
+            std::lock_guard lock{ mutex };
+            if (dispatcher) {
+                dispatcher->emit();
+            }
+        }
+    }
+};
+
+StdinReader::StdinReader(int fd): state{ std::make_shared<State>() } {
+    // detached: the producer may never close its end
+    std::thread([state = state, fd]() {
+        constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+        // read, not handed over yet
+        std::string chunk;
+        auto push = [&state](std::string& chunk) {
+            // the main loop is behind, let it catch up
+            while (!state->queue.push(chunk)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+            }
+            state->notify();
+        };
+        while (true) {
+            auto size = chunk.size();
+            chunk.resize(size + BLOCK_SIZE);
+            auto n = ::read(fd, chunk.data() + size, BLOCK_SIZE);
+            chunk.resize(size + std::max<ssize_t>(n, 0));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            // hand over the complete lines a slow producer has written so far
+            if (auto eol = chunk.rfind('\n'); eol != chunk.npos) {
+                std::string rest{ chunk, eol + 1 };
+                chunk.resize(eol + 1);
+                push(chunk);
+                chunk = std::move(rest);
+            }
+        }
+        if (!chunk.empty()) {
+            chunk.push_back('\n');
+            push(chunk);
+        }
+        state->eof.store(true, std::memory_order_release);
+        state->notify();
+    }).detach();
+}
+
+StdinReader::~StdinReader() {
+    std::lock_guard lock{ state->mutex };
+    state->dispatcher = nullptr;
+}
+
+void StdinReader::drain(CommandList& lines) {
+    std::string chunk;
+    while (state->queue.pop(chunk)) {
+        lines.append(chunk);
+    }
+}
+
+void StdinReader::read(CommandList& lines, std::size_t count) {
+    while (!finished) {
+        // chunks pushed before the end of input are in the queue once it is seen
+        auto eof = state->eof.load(std::memory_order_acquire);
+        drain(lines);
+        finished = eof;
+        if (lines.size() >= count) {
+            break;
+        }
+        if (!finished) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+        }
+    }
+}
+
+void StdinReader::on_lines(CommandList& lines, std::function<void(std::size_t)> callback_) {
+    target = &lines;
+    callback = std::move(callback_);
+    dispatcher = std::make_unique<Glib::Dispatcher>();
+    dispatcher->connect(sigc::mem_fun(*this, &StdinReader::deliver));
+    std::lock_guard lock{ state->mutex };
+    state->dispatcher = dispatcher.get();
+    // some may have been read already
+    dispatcher->emit();
+}
+
+void StdinReader::deliver() {
+    if (finished) {
+        return;
+    }
+    state->notified.store(false);
+    auto eof = state->eof.load(std::memory_order_acquire);
+    auto from = target->size();
+    drain(*target);
+    finished = eof;
+    if (target->size() != from || finished) {
+        callback(from);
     }
-    return command_paths;
 }
 
 void on_item_clicked(std::string cmd) {
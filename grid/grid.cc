@@ -11,15 +11,21 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
+#include <algorithm>
 #include <charconv>
+#include <clocale>
 
 #include "nwg_tools.h"
 #include "nwg_classes.h"
+#include "alloc_stats.h"
 #include "on_event.h"
+#include "readahead.h"
+#include "replay.h"
 #include "grid.h"
 
 bool pins = false;              // whether to display pinned
 bool favs = false;              // whether to display favorites
+bool focus_running = false;     // whether to focus a running instance instead of launching another
 std::string wm {""};            // detected or forced window manager name
 std::string term {""};
 std::size_t num_col = 6;        // number of grid columns
@@ -36,6 +42,7 @@ Options:\n\
 -h               show this help message and exit\n\
 -f               display favourites (most used entries); does not work with -d\n\
 -p               display pinned entries; does not work with -d \n\
+-r               focus the running instance of an application instead of starting another (sway, i3)\n\
 -d               look for .desktop files in custom paths (-d '/my/path1:/my/another path:/third/path') \n\
 -o <opacity>     default (black) background opacity (0.0 - 1.0, default 0.9)\n\
 -b <background>  background colour in RRGGBB or RRGGBBAA format (RRGGBBAA alpha overrides <opacity>)\n\
@@ -43,26 +50,44 @@ Options:\n\
 -s <size>        button image size (default: 72)\n\
 -c <name>        css file name (default: style.css)\n\
 -l <ln>          force use of <ln> language\n\
+-t <ms>          time budget for scanning .desktop files, slower directories are loaded in background (default: 300)\n\
+--dump [json]    print the entries in the order of the grid as TSV (or JSON) and exit, without a display\n\
 -wm <wmname>     window manager name (if can not be detected)\n";
 
 int main(int argc, char *argv[]) {
+    // names are sorted before Gtk sets the locale, and --dump never sets it
+    setlocale(LC_ALL, "");
     std::string custom_css_file {"style.css"};
 
     struct timeval tp;
     gettimeofday(&tp, NULL);
     long int start_ms = tp.tv_sec * 1000 + tp.tv_usec / 1000;
 
-    create_pid_file_or_kill_pid("nwggrid");
-
-    std::string lang ("");
-
     InputParser input(argc, argv);
     if (input.cmdOptionExists("-h")){
         std::cout << HELP_MESSAGE;
         std::exit(0);
     }
+
+    // a dump runs beside the grid and without most of the files it reads,
+    // so it neither replaces the running grid nor records the readahead manifest
+    auto dump = input.cmdOptionExists("--dump");
+    auto dump_format = input.getCmdOption("--dump") == "json" ? DumpFormat::Json : DumpFormat::Tsv;
+    std::ostream catalog{ std::cout.rdbuf() };
+    std::optional<StartupReadahead> readahead;
+    if (dump) {
+        // stdout is for the catalog only
+        std::cout.rdbuf(std::cerr.rdbuf());
+    } else {
+        create_pid_file_or_kill_pid("nwggrid");
+        readahead.emplace("nwggrid");
+    }
+    AllocStats alloc_stats;
+
+    std::string lang ("");
     favs = input.cmdOptionExists("-f") && !input.cmdOptionExists("-d");
     pins = input.cmdOptionExists("-p") && !input.cmdOptionExists("-d");
+    focus_running = input.cmdOptionExists("-r");
     auto forced_lang = input.getCmdOption("-l");
     if (!forced_lang.empty()){
         lang = forced_lang;
@@ -82,6 +107,19 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // nothing is shown before a dump, so it waits for all the directories unless told otherwise
+    std::chrono::milliseconds scan_budget{ dump ? std::chrono::hours{ 24 } : std::chrono::milliseconds{ 300 } };
+    auto budget = input.getCmdOption("-t");
+    if (!budget.empty()) {
+        int ms;
+        auto [p, ec] = std::from_chars(budget.data(), budget.data() + budget.size(), ms);
+        if (ec == std::errc() && ms >= 0) {
+            scan_budget = std::chrono::milliseconds{ ms };
+        } else {
+            std::cerr << "\nERROR: Invalid time budget\n\n";
+        }
+    }
+
     auto css_name = input.getCmdOption("-c");
     if (!css_name.empty()){
         custom_css_file = css_name;
@@ -198,64 +236,59 @@ int main(int argc, char *argv[]) {
 
     gettimeofday(&tp, NULL);
     long int commons_ms  = tp.tv_sec * 1000 + tp.tv_usec / 1000;
+    AllocStats::phase("commons");
+
+    // The first file with a given desktop-id wins, only shown entries get an index
+    EntryTable table{ term };
+    DirScanner scanner(dirs, lang, term);
+    auto scans = scanner.wait_for(scan_budget);
+    for (std::size_t i = 0; i < scans.size(); i++) {
+        table.merge(scans[i], i);
+    }
 
-    // Maps desktop-ids to their table indices, nullopt stands for 'hidden'
-    std::unordered_map<std::string, std::optional<std::size_t>> desktop_ids;
-
-    // Table, only contains shown entries
-    std::vector<DesktopEntry> desktop_entries;
-    std::vector<std::string>  execs;
     std::vector<Stats>        stats;
     std::vector<Gtk::Image*>  images;
-
-    auto desktop_id = [](auto& path) {
-        return path.string(); // actual desktop_id requires '/' to be replaced with '-'
-    };
-
-    for (auto& dir : dirs) {
-        std::error_code ec;
-        auto dir_iter = fs::directory_iterator(dir, ec);
-        for (auto& entry : dir_iter) {
-            if (ec) {
-                std::cerr << ec.message() << '\n';
-                ec.clear();
-                continue;
-            }
-            if (!entry.is_regular_file()) {
-                continue;
-            }
-            auto& path = entry.path();
-            auto&& rel_path = path.lexically_relative(dir);
-            auto&& id = desktop_id(rel_path);
-            if (auto [at, inserted] = desktop_ids.try_emplace(id, std::nullopt); inserted) {
-                if (auto entry = desktop_entry(path, lang)) {
-                    at->second = execs.size(); // set index
-                    execs.emplace_back(entry->exec);
-                    desktop_entries.emplace_back(std::move(*entry));
-                    stats.emplace_back(0, 0, Stats::Common, Stats::Unpinned);
-                    images.emplace_back(nullptr);
-                }
-            }
-        }
-    }
+    stats.resize(table.size(), Stats{ 0, 0, Stats::Common, Stats::Unpinned });
+    images.resize(table.size(), nullptr);
 
     int pin_index = 0; // preserve pins order
     for (auto& pin : pinned) {
-        if (auto result = desktop_ids.find(pin); result != desktop_ids.end() && result->second) {
-            stats[*result->second].pinned = Stats::Pinned;
-            stats[*result->second].position = pin_index;
+        if (auto index = table.find(pin)) {
+            stats[*index].pinned = Stats::Pinned;
+            stats[*index].position = pin_index;
             pin_index++;
         }
     }
     for (auto& [fav, clicks] : favourites) {
-        if (auto result = desktop_ids.find(fav); result != desktop_ids.end() && result->second) {
-            stats[*result->second].clicks   = clicks;
-            stats[*result->second].favorite = Stats::Favorite;
+        if (auto index = table.find(fav)) {
+            stats[*index].clicks   = clicks;
+            stats[*index].favorite = Stats::Favorite;
         }
     }
 
     gettimeofday(&tp, NULL);
     long int bs_ms  = tp.tv_sec * 1000 + tp.tv_usec / 1000;
+    AllocStats::phase("bs");
+
+    // each interval is named after the phase it starts
+    auto format = [&cout=std::cout](auto&& title, auto from, auto to) {
+        cout << title << to - from << "ms\n";
+    };
+
+    if (dump) {
+        gettimeofday(&tp, NULL);
+        long int dump_ms = tp.tv_sec * 1000 + tp.tv_usec / 1000;
+        AllocStats::phase("dump");
+        dump_catalog(catalog, table, stats, dump_format);
+        catalog.flush();
+        gettimeofday(&tp, NULL);
+        long int end_ms = tp.tv_sec * 1000 + tp.tv_usec / 1000;
+        format("Total: ", start_ms, end_ms);
+        format("\tdump:    ", dump_ms, end_ms);
+        format("\tbs:      ", bs_ms, dump_ms);
+        format("\tcommons: ", commons_ms, bs_ms);
+        return EXIT_SUCCESS;
+    }
 
     auto app = Gtk::Application::create();
 
@@ -273,70 +306,108 @@ int main(int argc, char *argv[]) {
         std::exit(EXIT_FAILURE);
     }
     auto& icon_theme_ref = *icon_theme.get();
+    auto settings = Gtk::Settings::get_for_screen(screen);
+    IconIndex icon_index{ settings->property_gtk_icon_theme_name().get_value(), image_size };
+    std::cout << icon_index.size() << " icons " << (icon_index.cached() ? "loaded" : "indexed") << '\n';
     auto icon_missing = Gdk::Pixbuf::create_from_file(DATA_DIR_STR "/nwgbar/icon-missing.svg");
 
     if (!std::filesystem::is_regular_file(css_file)) {
         css_file = default_css_file;
     }
     provider->load_from_path(css_file);
+    StartupReadahead::note(css_file);
     std::cout << "Using " << css_file << '\n';
 
-    MainWindow window(execs, stats);
+    MainWindow window(table, stats);
     window.set_background_color(background_color);
     window.show();
 
-    /* Detect focused display geometry: {x, y, w, h} */
-    auto [x, y, w, h] = display_geometry(wm, display, window.get_window());
-    std::cout << "Focused display: " << x << ", " << y << ", " << w << ", "
-    << h << '\n';
-
-    /* turn off borders, enable floating on sway */
-    if (wm == "sway") {
-        SwaySock sock;
-        sock.run("for_window [title=~nwggrid*] floating enable");
-        sock.run("for_window [title=~nwggrid*] border none");
-    }
+    // the compositor sizes and places a layer surface by itself
+    if (!window.is_layer_surface()) {
+        /* Detect focused display geometry: {x, y, w, h} */
+        auto [x, y, w, h] = display_geometry(wm, display, window.get_window());
+        std::cout << "Focused display: " << x << ", " << y << ", " << w << ", "
+        << h << '\n';
+
+        /* turn off borders, enable floating on sway */
+        if (wm == "sway") {
+            SwaySock sock;
+            sock.run("for_window [title=~nwggrid*] floating enable");
+            sock.run("for_window [title=~nwggrid*] border none");
+        }
 
-    if (wm == "sway" || wm == "i3" || wm == "openbox") {
-        window.resize(w, h);
-        window.move(x, y);
+        if (wm == "sway" || wm == "i3" || wm == "openbox") {
+            window.resize(w, h);
+            window.move(x, y);
+        }
     }
 
     gettimeofday(&tp, NULL);
     long int images_ms  = tp.tv_sec * 1000 + tp.tv_usec / 1000;
+    AllocStats::phase("images");
 
     // The most expensive part
-    for (std::size_t i = 0; i < desktop_entries.size(); i++) {
-        images[i] = app_image(icon_theme_ref, desktop_entries[i].icon, icon_missing);
+    for (std::size_t i = 0; i < table.size(); i++) {
+        images[i] = app_image(icon_theme_ref, icon_index, std::string{ table.get(table[i].icon) }, icon_missing);
     }
 
     gettimeofday(&tp, NULL);
     long int boxes_ms = tp.tv_sec * 1000 + tp.tv_usec / 1000;
+    AllocStats::phase("boxes");
 
-    for (auto& [desktop_id, pos_] : desktop_ids) {
-        if (pos_) {
-            auto pos = *pos_;
-            auto& entry = desktop_entries[pos];
-            auto& ab = window.emplace_box(std::move(entry.name),
-                                          std::move(entry.comment),
-                                          desktop_id,
-                                          pos);
-            ab.set_image_position(Gtk::POS_TOP);
-            ab.set_image(*images[pos]);
-        }
+    for (std::size_t i = 0; i < table.size(); i++) {
+        auto& ab = window.emplace_box(table.get(table[i].name), i);
+        ab.set_image_position(Gtk::POS_TOP);
+        ab.set_image(*images[i]);
     }
 
     gettimeofday(&tp, NULL);
     long int grids_ms = tp.tv_sec * 1000 + tp.tv_usec / 1000;
+    AllocStats::phase("grids");
 
     window.build_grids();
 
+    // scans of the directories which missed the budget replace their cached entries
+    scanner.on_late([&](std::size_t rank, EntryTable&& scan) {
+        auto merged = table.merge(scan, rank);
+        stats.resize(table.size(), Stats{ 0, 0, Stats::Common, Stats::Unpinned });
+        for (auto index : merged.removed) {
+            if (auto box = window.box_of(index)) {
+                window.remove_box(*box);
+            }
+        }
+        for (auto [from, to] : merged.replaced) {
+            stats[to] = stats[from];
+            if (auto box = window.box_of(from)) {
+                window.update_box(*box, to);
+                box->set_image(*app_image(icon_theme_ref, icon_index, std::string{ table.get(table[to].icon) }, icon_missing));
+            }
+        }
+        for (auto index : merged.added) {
+            auto& entry = table[index];
+            auto desktop_id = table.get(entry.desktop_id);
+            auto& stats_ = stats[index];
+            if (std::find(pinned.begin(), pinned.end(), desktop_id) != pinned.end()) {
+                stats_.pinned = Stats::Pinned;
+            }
+            auto fav = std::find_if(favourites.begin(), favourites.end(), [desktop_id](auto& f) {
+                return f.desktop_id == desktop_id;
+            });
+            if (fav != favourites.end()) {
+                stats_.clicks = fav->clicks;
+                stats_.favorite = Stats::Favorite;
+            }
+            auto& ab = window.emplace_box(table.get(entry.name), index);
+            ab.set_image_position(Gtk::POS_TOP);
+            ab.set_image(*app_image(icon_theme_ref, icon_index, std::string{ table.get(entry.icon) }, icon_missing));
+            window.attach_box(ab);
+        }
+    });
+
     gettimeofday(&tp, NULL);
     long int end_ms = tp.tv_sec * 1000 + tp.tv_usec / 1000;
+    AllocStats::phase("run");
 
-    auto format = [&cout=std::cout](auto&& title, auto from, auto to) {
-        cout << title << to - from << "ms\n";
-    };
     format("Total: ", start_ms, end_ms);
     format("\tgrids:   ", grids_ms, end_ms);
     format("\tboxes:   ", boxes_ms, grids_ms);
@@ -344,5 +415,8 @@ int main(int argc, char *argv[]) {
     format("\tbs:      ", bs_ms, images_ms);
     format("\tcommons: ", commons_ms, bs_ms);
 
+    InputReplay replay;
+    replay.start(window);
+
     return app->run(window);
 }
@@ -6,10 +6,15 @@
  * License: GPL3
  * */
 
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <functional>
+#include <memory>
 #include <optional>
+#include <string_view>
+#include <thread>
 
 #include <gtkmm.h>
 #include <glibmm/ustring.h>
@@ -24,6 +29,7 @@ namespace ns = nlohmann;
 
 extern bool pins;
 extern bool favs;
+extern bool focus_running;
 extern std::string wm;
 
 extern std::size_t num_col;
@@ -34,15 +40,6 @@ extern ns::json cache;
 extern std::string cache_file;
 extern std::string term;
 
-/* Primitive version of C++20's std::span */
-template <typename T>
-struct Span {
-    Span(const Span& s) = default;
-    Span(std::vector<T>& t): _ref(t.data()) { }
-    T& operator [](std::size_t n) { return _ref[n]; }
-    T* _ref;
-};
-
 struct Stats {
     enum FavTag: bool {
         Common = 0,
@@ -60,25 +57,167 @@ struct Stats {
       : clicks(c), position(i), favorite(f), pinned(p) { }
 };
 
+// Handle of a string in StringPool
+struct PoolString {
+    std::uint32_t offset;
+    std::uint32_t size;
+};
+
+/*
+ * Strings stored back to back in a single buffer, each followed by NUL.
+ * Handles stay valid as the pool grows, views only until the next `add`
+ * */
+class StringPool {
+    public:
+        PoolString add(std::string_view str);
+        // `prefix` and `str` separated by a space
+        PoolString add(std::string_view prefix, std::string_view str);
+        std::string_view get(PoolString str) const {
+            return { data.data() + str.offset, str.size };
+        }
+        std::size_t capacity() const { return data.capacity(); }
+    private:
+        std::vector<char> data;
+};
+
+/*
+ * Maps desktop-ids stored in a StringPool to table indices, HIDDEN for hidden entries,
+ * along with the rank of the directory each id comes from.
+ * Open addressing with linear probing, the table is kept at most half full
+ * */
+class DesktopIds {
+    public:
+        static constexpr std::uint32_t HIDDEN = 0xFFFFFFFF;
+        static constexpr std::uint32_t LAST = 0xFFFFFFFF; // rank after all directories
+
+        struct Slot {
+            std::uint32_t hash;  // 0 marks an empty slot
+            std::uint32_t value;
+            PoolString    key;
+            std::uint32_t rank;  // position of the directory in the search path
+        };
+
+        // returns the slot of `id`, null if absent; valid until the next insertion
+        Slot* find(const StringPool& pool, std::string_view id);
+        const Slot* find(const StringPool& pool, std::string_view id) const;
+        // adds `id` to `pool` and the map unless it is there, returns its slot and whether it was inserted
+        std::pair<Slot*, bool> try_emplace(StringPool& pool, std::string_view id, std::uint32_t value, std::uint32_t rank = 0);
+        // calls `fn(key, value)` for each id
+        template <typename F>
+        void for_each(F&& fn) const {
+            for (auto& slot : slots) {
+                if (slot.hash) {
+                    fn(slot.key, slot.value);
+                }
+            }
+        }
+        // calls `fn(slot)` for each id, the slots may be changed but not their keys
+        template <typename F>
+        void for_each_slot(F&& fn) {
+            for (auto& slot : slots) {
+                if (slot.hash) {
+                    fn(slot);
+                }
+            }
+        }
+        std::size_t size() const { return count; }
+        std::size_t capacity() const { return slots.capacity(); }
+    private:
+        std::vector<Slot> slots;
+        std::size_t       count = 0;
+
+        Slot* probe(const StringPool& pool, std::string_view id, std::uint32_t hash);
+};
+
+// Shown entry, strings are in the pool of its table
+struct Entry {
+    PoolString desktop_id;
+    PoolString name;
+    PoolString exec;     // with the terminal prefix if `terminal`
+    PoolString icon;
+    PoolString comment;
+    PoolString mime_type;
+    PoolString wm_class; // StartupWMClass
+    bool       terminal;
+};
+
+/*
+ * Shown .desktop entries and the desktop-ids of all the parsed ones; the first entry
+ * added with a given desktop-id wins, across merged tables the one of the lowest rank.
+ * Entries are never erased, entries replaced by `merge` are only unreachable by id
+ * */
+class EntryTable {
+    public:
+        // indices of entries changed by `merge`
+        struct Merged {
+            std::vector<std::size_t>                           added;
+            std::vector<std::pair<std::size_t, std::size_t>>   replaced; // old and new index
+            std::vector<std::size_t>                           removed;  // hidden or gone now
+        };
+
+        EntryTable() = default;
+        // `term` is prepended to exec of terminal entries
+        explicit EntryTable(std::string term);
+
+        // adds `id` as hidden unless it is already known, returns whether it was added
+        bool add_id(std::string_view id);
+        // shows `entry` as `id`, which has to be added with `add_id`
+        void set_entry(std::string_view id, const DesktopEntry& entry);
+        // add_id, then set_entry for shown entries
+        void add(std::string_view id, const std::optional<DesktopEntry>& entry);
+        /*
+         * Merges the entries of the directory ranked `rank` in the search path: ids known
+         * from a lower rank are kept, the others replaced. Merging a rank again, e.g. a scan
+         * after the cached entries, also removes the ids of the rank missing from `other`
+         * */
+        Merged merge(const EntryTable& other, std::uint32_t rank);
+        // orders the entries from `first` on by `keys`, one per entry, keeping their ids
+        void sort_from(std::size_t first, const std::vector<std::size_t>& keys);
+
+        // index of the entry of `id`, nullopt if it is hidden or unknown
+        std::optional<std::size_t> find(std::string_view id);
+        std::string_view get(PoolString str) const { return pool.get(str); }
+        DesktopEntry view(std::size_t index) const;
+        const Entry& operator[](std::size_t index) const { return entries[index]; }
+        std::size_t size() const { return entries.size(); }
+        std::string_view terminal_prefix() const { return term; }
+        // bytes allocated by the table
+        std::size_t capacity() const;
+
+        template <typename F>
+        void for_each_hidden(F&& fn) const {
+            ids.for_each([this, &fn](PoolString id, std::uint32_t value) {
+                if (value == DesktopIds::HIDDEN) {
+                    fn(pool.get(id));
+                }
+            });
+        }
+    private:
+        StringPool         pool;
+        DesktopIds         ids;
+        std::vector<Entry> entries;
+        std::vector<bool>  ranks; // merged so far
+        std::string        term;
+};
+
 class GridBox : public Gtk::Button {
 public:
-    /* name, comment, desktop-id, index */
-    GridBox(Glib::ustring, Glib::ustring, const std::string& id, std::size_t);
+    /* name, index */
+    GridBox(std::string_view, std::size_t);
     ~GridBox() = default;
+    void set_display_name(std::string_view);
     bool on_button_press_event(GdkEventButton*) override;
     bool on_focus_in_event(GdkEventFocus*) override;
     void on_enter() override;
     void on_activate() override;
 
-    Glib::ustring      name;
-    Glib::ustring      comment;
-    const std::string* desktop_id; // ptr to desktop-id, never null
-    std::size_t        index;      // row index
+    std::size_t index; // index in the entry table
 };
 
 class MainWindow : public CommonWindow {
     public:
-        MainWindow(Span<std::string> entries, Span<Stats> stats);
+        // table and stats may grow as late directories are scanned
+        MainWindow(EntryTable& table, std::vector<Stats>& stats);
         MainWindow(const MainWindow&) = delete;
 
         Gtk::SearchEntry searchbox;              // Search apps
@@ -100,12 +239,30 @@ class MainWindow : public CommonWindow {
         GridBox& emplace_box(Args&& ... args);      // emplace box
 
         void build_grids();
+        void attach_box(GridBox& box);
+        // points `box` at the entry `index` replacing its entry
+        void update_box(GridBox& box, std::size_t index);
+        void remove_box(GridBox& box);
+        // the box of the entry `index`, null if there is none
+        GridBox* box_of(std::size_t index);
         void toggle_pinned(GridBox& box);
         void set_description(const Glib::ustring&);
         void save_cache();
+        // focuses a window of the entry if it is already running, see `-r`
+        bool focus_window_of(const GridBox& box);
 
-        std::string& exec_of(const GridBox& box) {
-            return execs[box.index];
+        // views of the pool strings are NUL-terminated
+        std::string_view exec_of(const GridBox& box) const {
+            return table.get(table[box.index].exec);
+        }
+        std::string_view name_of(const GridBox& box) const {
+            return table.get(table[box.index].name);
+        }
+        std::string_view comment_of(const GridBox& box) const {
+            return table.get(table[box.index].comment);
+        }
+        std::string_view desktop_id_of(const GridBox& box) const {
+            return table.get(table[box.index].desktop_id);
         }
         Stats& stats_of(const GridBox& box) {
             return stats[box.index];
@@ -122,8 +279,8 @@ class MainWindow : public CommonWindow {
         std::vector<GridBox*> fav_boxes {};      // attached to favs_grid
         std::vector<GridBox*> pinned_boxes {};   // attached to pinned_grid
 
-        Span<std::string> execs;
-        Span<Stats>       stats;
+        EntryTable&         table;
+        std::vector<Stats>& stats;
 
         int  monotonic_index;       // to keep pins in order, see grid_classes.cc comment
         bool pins_changed = false;
@@ -154,6 +311,38 @@ struct CacheEntry {
     CacheEntry(std::string, int);
 };
 
+/*
+ * Scans application directories in background threads, so that a stalled mount
+ * delays only its own entries. Directories which miss the time budget are replaced
+ * with their cached entries, the actual results are passed to the `on_late` callback
+ * */
+class DirScanner {
+    public:
+        DirScanner(std::vector<std::string> dirs, const std::string& lang, const std::string& term);
+        DirScanner(const DirScanner&) = delete;
+        // stops the scans, waits for them no longer than the budget
+        ~DirScanner();
+
+        // returns entries of each directory in order, waits no longer than `budget`
+        std::vector<EntryTable> wait_for(std::chrono::milliseconds budget);
+        // calls `callback(rank, entries)` in the main loop as the late directories are scanned
+        void on_late(std::function<void(std::size_t, EntryTable&&)> callback);
+
+        struct State;
+    private:
+        std::vector<std::string>                       dirs;
+        std::string                                    term;
+        std::vector<std::thread>                       threads;
+        std::shared_ptr<State>                         state;
+        std::chrono::milliseconds                      budget{ 0 };
+        std::function<void(std::size_t, EntryTable&&)> callback;
+        std::unique_ptr<Glib::Dispatcher>              dispatcher;
+
+        void deliver_late();
+};
+
+enum class DumpFormat { Tsv, Json };
+
 /*
  * Function declarations
  * */
@@ -161,3 +350,9 @@ std::vector<std::string>    get_app_dirs(void);
 std::vector<std::string>    get_pinned(const std::filesystem::path& pinned_file);
 std::vector<CacheEntry>     get_favourites(ns::json&&, int);
 std::optional<DesktopEntry> desktop_entry(std::string&&, const std::string&);
+std::optional<DesktopEntry> parse_desktop_entry(std::string_view, const std::string&);
+void                        load_desktop_entries(const std::vector<std::string>&, const std::string&, EntryTable&);
+void                        dump_catalog(std::ostream&, const EntryTable&, const std::vector<Stats>&, DumpFormat);
+#ifdef HAVE_IO_URING
+bool                        load_desktop_entries_uring(const std::vector<std::string>&, const std::string&, EntryTable&);
+#endif
@@ -15,25 +15,41 @@
  * */
 
 #include "nwg_tools.h"
+#include "alloc_stats.h"
+#include "text_match.h"
 #include "grid.h"
 
 // we only store GridBoxes inside of our FlowBoxes, so dynamic_cast won't fail
 inline auto child_ = [](auto c) -> auto& { return *dynamic_cast<GridBox*>(c->get_child()); };
-int by_name(Gtk::FlowBoxChild* a, Gtk::FlowBoxChild* b) {
-    return child_(a).name.compare(child_(b).name);
-}
 // return -1 if a < b, 0 if a == b, 1 if a > b
 inline auto cmp_ = [](auto a, auto b) { return int(a > b) - int(a < b); };
+// ties go by desktop id, so the order does not depend on the scan order
+int by_desktop_id(MainWindow& toplevel, Gtk::FlowBoxChild* a, Gtk::FlowBoxChild* b) {
+    return cmp_(toplevel.desktop_id_of(child_(a)), toplevel.desktop_id_of(child_(b)));
+}
+int by_name(Gtk::FlowBoxChild* a, Gtk::FlowBoxChild* b) {
+    auto& toplevel = *dynamic_cast<MainWindow*>(a->get_toplevel());
+    if (auto c = g_utf8_collate(toplevel.name_of(child_(a)).data(), toplevel.name_of(child_(b)).data())) {
+        return c;
+    }
+    return by_desktop_id(toplevel, a, b);
+}
 int by_position(Gtk::FlowBoxChild* a, Gtk::FlowBoxChild* b) {
     auto& toplevel = *dynamic_cast<MainWindow*>(a->get_toplevel());
-    return cmp_(toplevel.stats_of(child_(a)).position, toplevel.stats_of(child_(b)).position);
+    if (auto c = cmp_(toplevel.stats_of(child_(a)).position, toplevel.stats_of(child_(b)).position)) {
+        return c;
+    }
+    return by_desktop_id(toplevel, a, b);
 }
 int by_clicks(Gtk::FlowBoxChild* a, Gtk::FlowBoxChild* b) {
     auto& toplevel = *dynamic_cast<MainWindow*>(a->get_toplevel());
-    return -cmp_(toplevel.stats_of(child_(a)).clicks, toplevel.stats_of(child_(b)).clicks);
+    if (auto c = -cmp_(toplevel.stats_of(child_(a)).clicks, toplevel.stats_of(child_(b)).clicks)) {
+        return c;
+    }
+    return by_desktop_id(toplevel, a, b);
 }
-MainWindow::MainWindow(Span<std::string> es, Span<Stats> ss)
- : CommonWindow("~nwggrid", "~nwggrid"), execs(es), stats(ss)
+MainWindow::MainWindow(EntryTable& t, std::vector<Stats>& ss)
+ : CommonWindow("~nwggrid", "~nwggrid"), table(t), stats(ss)
 {
     searchbox
         .signal_search_changed()
@@ -68,7 +84,10 @@ MainWindow::MainWindow(Span<std::string> es, Span<Stats> ss)
     // We can not go fullscreen() here:
     // On sway the window would become opaque - we don't want it
     // On i3 all windows below will be hidden - we don't want it as well
-    if (wm != "sway" && wm != "i3") {
+    // A layer surface already covers the output
+    if (is_layer_surface()) {
+        set_decorated(false);
+    } else if (wm != "sway" && wm != "i3") {
         fullscreen();
     } else {
         set_type_hint(Gdk::WINDOW_TYPE_HINT_SPLASHSCREEN);
@@ -112,6 +131,7 @@ bool MainWindow::on_button_press_event(GdkEventButton *event) {
 }
 
 bool MainWindow::on_key_press_event(GdkEventKey* key_event) {
+    this->latency.begin(LatencyProbe::Keystroke, *this);
     switch (key_event->keyval) {
         case GDK_KEY_Escape:
             this->close();
@@ -166,8 +186,25 @@ inline auto build_grid = [](auto& grid, auto& container) {
     refresh_max_children_per_line(grid, container);
 };
 
+/* Whether the box name, exec or comment contain the casefolded `phrase` */
+static bool matches_phrase(const MainWindow& window, const GridBox& box, const Glib::ustring& phrase) {
+    // casefolding ASCII text only makes its letters lower case, it is compared in place
+    auto ascii_phrase = is_ascii(phrase.raw());
+    auto matches = [&phrase, ascii_phrase](auto view) {
+        if (ascii_phrase && is_ascii(view)) {
+            return find_ascii_nocase(view, phrase.raw()) != std::string_view::npos;
+        }
+        return Glib::ustring{ view.data() }.casefold().find(phrase) != Glib::ustring::npos;
+    };
+    return matches(window.name_of(box)) ||
+           window.exec_of(box).find(phrase.raw()) != std::string_view::npos ||
+           matches(window.comment_of(box));
+}
+
 /* Called each time `search_entry` changes, rebuilds `apps_grid` according to search criteria */
 void MainWindow::filter_view() {
+    auto start = g_get_monotonic_time();
+    auto allocs = AllocStats::counters();
     auto clean_grid = [](auto& grid) {
         grid.foreach([&grid](auto& child) {
             grid.remove(child);
@@ -180,13 +217,8 @@ void MainWindow::filter_view() {
     apps_grid.freeze_child_notify();
     if (is_filtered) {
         auto phrase = search_phrase.casefold();
-        auto matches = [&phrase](auto& str) {
-            return str.casefold().find(phrase) != Glib::ustring::npos;
-        };
         for (auto* box : apps_boxes) {
-            auto& exec = this->exec_of(*box);
-            auto matches_exec = exec.find(phrase) != std::string::npos;
-            if (matches(box->name) || matches_exec || matches(box->comment)) {
+            if (matches_phrase(*this, *box, phrase)) {
                 filtered_boxes.push_back(box);
             }
         }
@@ -199,6 +231,8 @@ void MainWindow::filter_view() {
     this -> refresh_separators();
     this -> focus_first_box();
     apps_grid.thaw_child_notify();
+    this -> latency.record(LatencyProbe::Filter, start);
+    AllocStats::record_filter(allocs);
 }
 
 /* Sets separators' visibility according to grid status */
@@ -239,6 +273,83 @@ void MainWindow::build_grids() {
     this -> refresh_separators();
 }
 
+/* Adds a box emplaced after `build_grids` to its grid */
+void MainWindow::attach_box(GridBox& box) {
+    auto& stats = this->stats_of(box);
+    auto* grid = &this->apps_grid;
+    auto* boxes = &this->apps_boxes;
+    if (stats.pinned) {
+        stats.position = this->monotonic_index++;
+        grid = &this->pinned_grid;
+        boxes = &this->pinned_boxes;
+    } else if (stats.favorite) {
+        grid = &this->favs_grid;
+        boxes = &this->fav_boxes;
+    }
+    if (grid == &this->apps_grid && is_filtered) {
+        if (!matches_phrase(*this, box, searchbox.get_text().casefold())) {
+            return;
+        }
+        boxes = &this->filtered_boxes;
+        boxes->push_back(&box);
+    }
+    grid->add(box);
+    box.get_parent()->set_can_focus(false);
+    box.show();
+    refresh_max_children_per_line(*grid, *boxes);
+    this->refresh_separators();
+}
+
+void MainWindow::update_box(GridBox& box, std::size_t index) {
+    box.index = index;
+    box.set_display_name(name_of(box));
+    auto& stats = this->stats_of(box);
+    auto* grid = &this->apps_grid;
+    if (stats.pinned) {
+        grid = &this->pinned_grid;
+    } else if (stats.favorite) {
+        grid = &this->favs_grid;
+    }
+    // the name or the comment may not match anymore
+    if (grid == &this->apps_grid && is_filtered) {
+        this->filter_view();
+    } else {
+        grid->invalidate_sort();
+    }
+}
+
+void MainWindow::remove_box(GridBox& box) {
+    auto& stats = this->stats_of(box);
+    auto* grid = &this->apps_grid;
+    auto* boxes = &this->apps_boxes;
+    if (stats.pinned) {
+        grid = &this->pinned_grid;
+        boxes = &this->pinned_boxes;
+    } else if (stats.favorite) {
+        grid = &this->favs_grid;
+        boxes = &this->fav_boxes;
+    }
+    // a filtered out box has no parent
+    if (auto* child = box.get_parent()) {
+        grid->remove(*child);
+        dynamic_cast<Gtk::FlowBoxChild*>(child)->remove();
+    }
+    boxes->erase(std::remove(boxes->begin(), boxes->end(), &box), boxes->end());
+    filtered_boxes.erase(std::remove(filtered_boxes.begin(), filtered_boxes.end(), &box), filtered_boxes.end());
+    all_boxes.remove_if([&box](auto& b) { return &b == &box; });
+    refresh_max_children_per_line(*grid, *boxes);
+    this->refresh_separators();
+}
+
+GridBox* MainWindow::box_of(std::size_t index) {
+    for (auto& box : this->all_boxes) {
+        if (box.index == index) {
+            return &box;
+        }
+    }
+    return nullptr;
+}
+
 void MainWindow::focus_first_box() {
     // flowbox -> flowboxchild -> gridbox
     if (is_filtered) {
@@ -321,7 +432,7 @@ void MainWindow::save_cache() {
         });
         std::ofstream out(pinned_file, std::ios::trunc);
         for (auto* pin : this->pinned_boxes) {
-            out << *pin->desktop_id << '\n';
+            out << desktop_id_of(*pin) << '\n';
         }
     }
     if (favs) {
@@ -336,28 +447,108 @@ void MainWindow::save_cache() {
         // only save positives, substract min to keep clicks low, but preserve order
         for (auto& box : this->all_boxes) {
             if (auto clicks = stats_of(box).clicks - min + 1; clicks > 0) {
-                favs_cache[*box.desktop_id] = clicks;
+                favs_cache[std::string{ desktop_id_of(box) }] = clicks;
             }
         }
         save_json(favs_cache, cache_file);
     }
 }
 
+/*
+ * Returns the basename of the program `exec` runs, skipping VAR=value assignments,
+ * options and the wrappers whose name says nothing about the window, e.g. `python3`
+ * in `env FOO=1 python3 /usr/bin/foo.py`. Empty if only wrappers are left
+ * */
+static std::string_view exec_name(std::string_view exec) {
+    using namespace std::string_view_literals;
+    constexpr std::array wrappers {
+        "env"sv, "sh"sv, "bash"sv, "python"sv, "python3"sv, "perl"sv, "ruby"sv, "java"sv,
+        "mono"sv, "wine"sv, "electron"sv, "flatpak"sv, "run"sv, "nice"sv, "firejail"sv
+    };
+    while (!exec.empty()) {
+        auto token = exec.substr(0, exec.find(' '));
+        exec.remove_prefix(std::min(exec.size(), token.size() + 1));
+        // a quoted program, or the command of `sh -c`
+        if (!token.empty() && (token.front() == '"' || token.front() == '\'')) {
+            token.remove_prefix(1);
+        }
+        if (!token.empty() && (token.back() == '"' || token.back() == '\'')) {
+            token.remove_suffix(1);
+        }
+        if (token.empty() || token.front() == '-' || token.find('=') != token.npos) {
+            continue;
+        }
+        auto name = take_last_by(token, "/");
+        if (std::find(wrappers.begin(), wrappers.end(), name) == wrappers.end()) {
+            return name;
+        }
+    }
+    return {};
+}
+
+/*
+ * Looks for a window of the entry of `box` in the sway/i3 tree and focuses it.
+ * A window matches by StartupWMClass, desktop-id (Wayland app_id) or, without
+ * StartupWMClass, the name of the executable. Returns false if there is none
+ * or the compositor can't be asked
+ * */
+bool MainWindow::focus_window_of(const GridBox& box) {
+    using namespace std::string_view_literals;
+    auto start = g_get_monotonic_time();
+    auto& entry = table[box.index];
+    std::vector<std::string_view> names;
+    if (entry.wm_class.size > 0) {
+        names.push_back(table.get(entry.wm_class));
+    }
+    auto id = take_last_by(table.get(entry.desktop_id), "/");
+    constexpr auto suffix = ".desktop"sv;
+    if (id.size() > suffix.size() && id.substr(id.size() - suffix.size()) == suffix) {
+        id.remove_suffix(suffix.size());
+    }
+    names.push_back(id);
+    // StartupWMClass is what the window is known by, the executable of a terminal entry is the terminal
+    if (entry.wm_class.size == 0 && !entry.terminal) {
+        if (auto name = exec_name(table.get(entry.exec)); !name.empty()) {
+            names.push_back(name);
+        }
+    }
+    std::optional<std::uint64_t> con_id;
+    try {
+        SwaySock sock;
+        con_id = sock.find_window(names);
+        latency.record(LatencyProbe::Focus, start);
+        if (con_id) {
+            sock.run("[con_id=" + std::to_string(*con_id) + "] focus");
+        }
+    } catch (const SwayError&) {
+        // no compositor to ask is measured as well
+        if (!con_id) {
+            latency.record(LatencyProbe::Focus, start);
+        }
+        return false;
+    }
+    return con_id.has_value();
+}
+
 bool MainWindow::on_delete_event(GdkEventAny* event) {
     this -> save_cache();
     return CommonWindow::on_delete_event(event);
 }
 
-GridBox::GridBox(Glib::ustring name, Glib::ustring comment, const std::string& id, std::size_t index)
-: name(std::move(name)), comment(std::move(comment)), desktop_id(&id), index(index) {
-    // As we sort dynamically by actual names, we need to avoid shortening them, or long names will remain unsorted.
+GridBox::GridBox(std::string_view name, std::size_t index)
+: index(index) {
+    this->set_always_show_image(true);
+    this->set_display_name(name);
+}
+
+void GridBox::set_display_name(std::string_view name) {
+    // Names are sorted by the entry table strings, so only the label is shortened
     // See the issue: https://github.com/nwg-piotr/nwg-launchers/issues/128
-    auto display_name = this->name;
+    Glib::ustring display_name{ std::string{ name } };
     if (display_name.length() > 25) {
        display_name.resize(22);
        display_name += "...";
     }
-    this->set_always_show_image(true);
     this->set_label(display_name);
 }
 
@@ -375,20 +566,24 @@ bool GridBox::on_focus_in_event(GdkEventFocus* event) {
     (void) event; // suppress warning
 
     auto& toplevel = *dynamic_cast<MainWindow*>(this->get_toplevel());
-    toplevel.set_description(comment);
+    toplevel.set_description(toplevel.comment_of(*this).data());
     return true;
 }
 
 void GridBox::on_enter() {
     auto& toplevel = *dynamic_cast<MainWindow*>(this->get_toplevel());
-    toplevel.set_description(comment);
+    toplevel.set_description(toplevel.comment_of(*this).data());
     return Gtk::Button::on_enter();
 }
 
 void GridBox::on_activate() {
     auto& toplevel = *dynamic_cast<MainWindow*>(this->get_toplevel());
     toplevel.stats_of(*this).clicks++;
-    std::string cmd = toplevel.exec_of(*this);
+    if (focus_running && toplevel.focus_window_of(*this)) {
+        toplevel.close();
+        return;
+    }
+    std::string cmd{ toplevel.exec_of(*this) };
     cmd += " &";
     if (cmd.find(term) == 0) {
         std::cout << "Running: \'" << cmd << "\'\n";
@@ -6,12 +6,28 @@
  * License: GPL3
  * */
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
 #include <string_view>
-#include <variant>
+
+#include "nwgconfig.h"
+#ifdef HAVE_IO_URING
+#include <liburing.h>
+#endif
 
 #include "nwg_tools.h"
 #include "grid.h"
+#include "readahead.h"
 
 CacheEntry::CacheEntry(std::string desktop_id, int clicks): desktop_id(std::move(desktop_id)), clicks(clicks) { }
 
@@ -73,110 +89,782 @@ std::vector<std::string> get_app_dirs() {
 }
 
 // desktop_entry helpers
-template<typename> inline constexpr bool lazy_false_v = false;
-template<typename ... Ts> struct visitor : Ts... { using Ts::operator()...; };
-template<typename ... Ts> visitor(Ts...) -> visitor<Ts...>;
+// FNV-1a, lets `switch` dispatch on key names; duplicate case labels fail to compile
+static constexpr std::uint32_t key_hash(std::string_view key) {
+    std::uint32_t hash = 2166136261u;
+    for (auto c : key) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return hash;
+}
 
-/*
- * Parses .desktop file to DesktopEntry struct
- * */
-std::optional<DesktopEntry> desktop_entry(std::string&& path, const std::string& lang) {
-    using namespace std::literals::string_view_literals;
+enum class Key { Other, Name, Exec, Icon, Comment, MimeType, NoDisplay, Terminal, StartupWMClass };
 
-    DesktopEntry entry;
-    entry.terminal = false;
+static constexpr Key key_of(std::string_view key) {
+    using namespace std::literals::string_view_literals;
+    constexpr std::pair<std::string_view, Key> keys[] = {
+        { "Name"sv, Key::Name },
+        { "Exec"sv, Key::Exec },
+        { "Icon"sv, Key::Icon },
+        { "Comment"sv, Key::Comment },
+        { "MimeType"sv, Key::MimeType },
+        { "NoDisplay"sv, Key::NoDisplay },
+        { "Terminal"sv, Key::Terminal },
+        { "StartupWMClass"sv, Key::StartupWMClass }
+    };
+    std::size_t i = 0;
+    switch (key_hash(key)) {
+        case key_hash("Name"sv):           i = 0; break;
+        case key_hash("Exec"sv):           i = 1; break;
+        case key_hash("Icon"sv):           i = 2; break;
+        case key_hash("Comment"sv):        i = 3; break;
+        case key_hash("MimeType"sv):       i = 4; break;
+        case key_hash("NoDisplay"sv):      i = 5; break;
+        case key_hash("Terminal"sv):       i = 6; break;
+        case key_hash("StartupWMClass"sv): i = 7; break;
+        default: return Key::Other;
+    }
+    // unknown keys may share the hash
+    return keys[i].first == key ? keys[i].second : Key::Other;
+}
 
-    std::ifstream file(path);
-    std::string str;
+/*
+ * Reads the whole file into a per-thread buffer, usually with a single read(2).
+ * The view is valid until the next call on the same thread, empty on failure.
+ * */
+static std::string_view read_desktop_file(const char* path) {
+    thread_local std::unique_ptr<char[]> buffer;
+    thread_local std::size_t capacity = 0;
+    if (!buffer) {
+        capacity = 64 * 1024;
+        buffer.reset(new char[capacity]);
+    }
+    auto fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return {};
+    }
+    std::size_t size = 0;
+    while (true) {
+        auto n = read(fd, buffer.get() + size, capacity - size);
+        if (n < 0) {
+            size = 0;
+            break;
+        }
+        size += n;
+        // a short read of a regular file means EOF
+        if (size < capacity) {
+            break;
+        }
+        auto grown = std::make_unique<char[]>(capacity * 2);
+        std::copy_n(buffer.get(), size, grown.get());
+        buffer = std::move(grown);
+        capacity *= 2;
+    }
+    close(fd);
+    return { buffer.get(), size };
+}
 
-    std::string name_ln {};         // localized: Name[ln]=
-    std::string loc_name = "Name[" + lang + "]=";
+/*
+ * Parses the [Desktop Entry] group of a .desktop file to DesktopEntry struct
+ * of views into `contents`
+ * */
+std::optional<DesktopEntry> parse_desktop_entry(std::string_view contents, const std::string& lang) {
+    using namespace std::literals::string_view_literals;
+    constexpr auto header = "[Desktop Entry]"sv;
 
-    std::string comment_ln {};      // localized: Comment[ln]=
-    std::string loc_comment = "Comment[" + lang + "]=";
+    std::string_view name, name_ln, exec, icon, comment, comment_ln, mime_type, wm_class;
+    bool terminal = false;
 
-    struct nop_t { } nop;
-    struct cut_t { } cut;
-    struct Match {
-        std::string_view           prefix;
-        std::string*               dest;
-        std::variant<nop_t, cut_t> tag;
-    };
-    struct Result {
-        bool   ok;
-        size_t pos;
+    auto next_line = [&contents]() {
+        auto end = contents.find('\n');
+        auto line = contents.substr(0, end);
+        contents.remove_prefix(end == contents.npos ? contents.size() : end + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        return line;
     };
-    Match matches[] = {
-        { "Name="sv,     &entry.name,      nop },
-        { loc_name,      &name_ln,         nop },
-        { "Exec="sv,     &entry.exec,      cut },
-        { "Icon="sv,     &entry.icon,      nop },
-        { "Comment="sv,  &entry.comment,   nop },
-        { loc_comment,   &comment_ln,      nop },
-        { "MimeType="sv, &entry.mime_type, nop },
+    auto trim = [](std::string_view s) {
+        auto from = s.find_first_not_of(" \t");
+        if (from == s.npos) {
+            return std::string_view{};
+        }
+        return s.substr(from, s.find_last_not_of(" \t") - from + 1);
     };
 
     // Skip everything not related
-    constexpr auto header = "[Desktop Entry]"sv;
-    while (std::getline(file, str)) {
-        str.resize(header.size());
-        if (str == header) {
-            break;
-        }
-    }
+    while (!contents.empty() && next_line().substr(0, header.size()) != header);
     // Repeat until the next section
-    constexpr auto nodisplay = "NoDisplay=true"sv;
-    constexpr auto terminal = "Terminal=true"sv;
-    while (std::getline(file, str)) {
-        if (str[0] == '[') { // new section begins, break
+    while (!contents.empty()) {
+        auto line = next_line();
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (line[0] == '[') { // new section begins, break
             break;
         }
-        auto view = std::string_view{str};
-        auto view_len = std::size(view);
-        if (view == nodisplay) {
-            return std::nullopt;
+        auto eq = line.find('=');
+        if (eq == line.npos) {
+            continue;
         }
-        if (view == terminal) {
-            entry.terminal = true;
+        auto key = trim(line.substr(0, eq));
+        auto value = trim(line.substr(eq + 1));
+        // Key[locale]=value
+        std::string_view locale;
+        if (auto bracket = key.find('['); bracket != key.npos && key.back() == ']') {
+            locale = key.substr(bracket + 1, key.size() - bracket - 2);
+            key = key.substr(0, bracket);
+            if (locale != lang) {
+                continue;
+            }
         }
-        auto try_strip_prefix = [&view, view_len](auto& prefix) {
-            auto len = std::min(view_len, std::size(prefix));
-            return Result {
-                prefix == view.substr(0, len),
-                len
-            };
-        };
-        for (auto& [prefix, dest, tag] : matches) {
-            if (auto [ok, pos] = try_strip_prefix(prefix); ok) {
-                std::visit(visitor {
-                    [dest=dest, pos=pos, &view](nop_t) { *dest = view.substr(pos); },
-                    [dest=dest, pos=pos, &view](cut_t) {
-                        auto idx = view.find(" %", pos);
-                        if (idx == std::string_view::npos) {
-                            idx = std::size(view);
-                        }
-                        *dest = view.substr(pos, idx - pos);
-                    }
-                },
-                tag);
+        auto localized = !locale.empty();
+        switch (key_of(key)) {
+            case Key::Name:
+                (localized ? name_ln : name) = value;
+                break;
+            case Key::Comment:
+                (localized ? comment_ln : comment) = value;
+                break;
+            case Key::Exec:
+                exec = value.substr(0, value.find(" %"));
+                break;
+            case Key::Icon:
+                icon = value;
+                break;
+            case Key::MimeType:
+                mime_type = value;
+                break;
+            case Key::NoDisplay:
+                if (value == "true"sv) {
+                    return std::nullopt;
+                }
+                break;
+            case Key::Terminal:
+                terminal = value == "true"sv;
+                break;
+            case Key::StartupWMClass:
+                wm_class = value;
+                break;
+            case Key::Other:
                 break;
-            }
         }
     }
 
     if (!name_ln.empty()) {
-        entry.name = std::move(name_ln);
+        name = name_ln;
     }
     if (!comment_ln.empty()) {
-        entry.comment = std::move(comment_ln);
+        comment = comment_ln;
     }
-    if (entry.name.empty() || entry.exec.empty()) {
+    if (name.empty() || exec.empty()) {
         return std::nullopt;
     }
-    if (entry.terminal) {
-        entry.exec = term + " " + entry.exec;
+    return DesktopEntry{ name, exec, icon, comment, mime_type, wm_class, terminal };
+}
+
+/*
+ * Parses .desktop file to DesktopEntry struct, valid until the next call on the same thread
+ * */
+std::optional<DesktopEntry> desktop_entry(std::string&& path, const std::string& lang) {
+    return parse_desktop_entry(read_desktop_file(path.c_str()), lang);
+}
+
+PoolString StringPool::add(std::string_view str) {
+    return add({}, str);
+}
+
+PoolString StringPool::add(std::string_view prefix, std::string_view str) {
+    PoolString result{ static_cast<std::uint32_t>(data.size()), 0 };
+    if (!prefix.empty()) {
+        data.insert(data.end(), prefix.begin(), prefix.end());
+        data.push_back(' ');
+    }
+    data.insert(data.end(), str.begin(), str.end());
+    result.size = data.size() - result.offset;
+    data.push_back('\0');
+    return result;
+}
+
+DesktopIds::Slot* DesktopIds::probe(const StringPool& pool, std::string_view id, std::uint32_t hash) {
+    auto mask = slots.size() - 1;
+    for (auto i = hash & mask; ; i = (i + 1) & mask) {
+        auto& slot = slots[i];
+        if (!slot.hash || (slot.hash == hash && pool.get(slot.key) == id)) {
+            return &slot;
+        }
+    }
+}
+
+DesktopIds::Slot* DesktopIds::find(const StringPool& pool, std::string_view id) {
+    if (slots.empty()) {
+        return nullptr;
+    }
+    auto slot = probe(pool, id, key_hash(id) | 1);
+    return slot->hash ? slot : nullptr;
+}
+
+const DesktopIds::Slot* DesktopIds::find(const StringPool& pool, std::string_view id) const {
+    return const_cast<DesktopIds*>(this)->find(pool, id);
+}
+
+std::pair<DesktopIds::Slot*, bool> DesktopIds::try_emplace(StringPool& pool, std::string_view id, std::uint32_t value, std::uint32_t rank) {
+    if ((count + 1) * 2 > slots.size()) {
+        std::vector<Slot> old(std::max<std::size_t>(64, slots.size() * 2), Slot{ 0, 0, { 0, 0 }, 0 });
+        old.swap(slots);
+        auto mask = slots.size() - 1;
+        for (auto& slot : old) {
+            if (slot.hash) {
+                auto i = slot.hash & mask;
+                while (slots[i].hash) {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = slot;
+            }
+        }
+    }
+    // hash 0 marks empty slots
+    auto hash = key_hash(id) | 1;
+    auto slot = probe(pool, id, hash);
+    if (slot->hash) {
+        return { slot, false };
+    }
+    *slot = Slot{ hash, value, pool.add(id), rank };
+    count++;
+    return { slot, true };
+}
+
+EntryTable::EntryTable(std::string term): term(std::move(term)) {}
+
+bool EntryTable::add_id(std::string_view id) {
+    return ids.try_emplace(pool, id, DesktopIds::HIDDEN).second;
+}
+
+void EntryTable::set_entry(std::string_view id, const DesktopEntry& entry) {
+    auto slot = ids.find(pool, id);
+    slot->value = entries.size();
+    entries.push_back({
+        slot->key,
+        pool.add(entry.name),
+        entry.terminal ? pool.add(term, entry.exec) : pool.add(entry.exec),
+        pool.add(entry.icon),
+        pool.add(entry.comment),
+        pool.add(entry.mime_type),
+        pool.add(entry.wm_class),
+        entry.terminal
+    });
+}
+
+void EntryTable::add(std::string_view id, const std::optional<DesktopEntry>& entry) {
+    if (add_id(id) && entry) {
+        set_entry(id, *entry);
+    }
+}
+
+static bool same_entry(const DesktopEntry& a, const DesktopEntry& b) {
+    return a.name == b.name && a.exec == b.exec && a.icon == b.icon && a.comment == b.comment
+        && a.mime_type == b.mime_type && a.wm_class == b.wm_class && a.terminal == b.terminal;
+}
+
+EntryTable::Merged EntryTable::merge(const EntryTable& other, std::uint32_t rank) {
+    Merged merged;
+    auto remerged = rank < ranks.size() && ranks[rank];
+    if (rank >= ranks.size()) {
+        ranks.resize(rank + 1, false);
+    }
+    ranks[rank] = true;
+
+    other.ids.for_each([&](PoolString id, std::uint32_t value) {
+        auto key = other.get(id);
+        auto [slot, inserted] = ids.try_emplace(pool, key, DesktopIds::HIDDEN, rank);
+        auto old = slot->value;
+        if (!inserted) {
+            // a directory earlier in the search path wins
+            if (slot->rank < rank) {
+                return;
+            }
+            slot->rank = rank;
+            if (old != DesktopIds::HIDDEN && value != DesktopIds::HIDDEN && same_entry(view(old), other.view(value))) {
+                return;
+            }
+            slot->value = DesktopIds::HIDDEN;
+        }
+        if (value == DesktopIds::HIDDEN) {
+            if (old != DesktopIds::HIDDEN && !inserted) {
+                merged.removed.push_back(old);
+            }
+            return;
+        }
+        if (old != DesktopIds::HIDDEN && !inserted) {
+            merged.replaced.emplace_back(old, entries.size());
+        } else {
+            merged.added.push_back(entries.size());
+        }
+        auto entry = other.view(value);
+        // `terminal` would prepend the prefix again
+        entry.terminal = false;
+        set_entry(key, entry);
+        entries.back().terminal = other[value].terminal;
+    });
+
+    if (remerged) {
+        // gone from the directory since it was merged; an entry of a later directory
+        // it shadowed is only shown on the next start
+        ids.for_each_slot([&](DesktopIds::Slot& slot) {
+            if (slot.rank != rank || other.ids.find(other.pool, pool.get(slot.key))) {
+                return;
+            }
+            if (slot.value != DesktopIds::HIDDEN) {
+                merged.removed.push_back(slot.value);
+            }
+            slot.value = DesktopIds::HIDDEN;
+            slot.rank = DesktopIds::LAST;
+        });
+    }
+    return merged;
+}
+
+void EntryTable::sort_from(std::size_t first, const std::vector<std::size_t>& keys) {
+    std::vector<std::size_t> order(entries.size() - first);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&keys](auto a, auto b) { return keys[a] < keys[b]; });
+    std::vector<Entry> sorted;
+    sorted.reserve(order.size());
+    for (auto i : order) {
+        sorted.push_back(entries[first + i]);
+    }
+    std::copy(sorted.begin(), sorted.end(), entries.begin() + first);
+    for (auto i = first; i < entries.size(); i++) {
+        ids.find(pool, pool.get(entries[i].desktop_id))->value = i;
+    }
+}
+
+std::optional<std::size_t> EntryTable::find(std::string_view id) {
+    auto slot = ids.find(pool, id);
+    if (!slot || slot->value == DesktopIds::HIDDEN) {
+        return std::nullopt;
+    }
+    return slot->value;
+}
+
+DesktopEntry EntryTable::view(std::size_t index) const {
+    auto& entry = entries[index];
+    return {
+        get(entry.name),
+        get(entry.exec),
+        get(entry.icon),
+        get(entry.comment),
+        get(entry.mime_type),
+        get(entry.wm_class),
+        entry.terminal
+    };
+}
+
+std::size_t EntryTable::capacity() const {
+    return pool.capacity() + ids.capacity() * sizeof(DesktopIds::Slot) + entries.capacity() * sizeof(Entry);
+}
+
+#ifdef HAVE_IO_URING
+/*
+ * load_desktop_entries using io_uring: each directory is opened once and listed,
+ * then opens, reads and closes of its files relative to the directory fd are submitted
+ * in batches, and files are parsed while the rest of the I/O is in flight.
+ * Returns false if io_uring is not usable, before touching `table`
+ * */
+bool load_desktop_entries_uring(const std::vector<std::string>& dirs, const std::string& lang, EntryTable& table) {
+    // each slot has at most two requests in flight: close of the previous file and open of the next one
+    constexpr unsigned QUEUE_DEPTH = 64;
+    constexpr unsigned SLOTS = QUEUE_DEPTH / 2;
+    constexpr std::size_t BUFFER_SIZE = 64 * 1024;
+    enum Op : std::uintptr_t { Open = 0, Read = 1, Close = 2 };
+
+    io_uring ring;
+    if (io_uring_queue_init(QUEUE_DEPTH, &ring, 0) < 0) {
+        return false;
+    }
+    auto probe = io_uring_get_probe_ring(&ring);
+    auto supported = probe
+        && io_uring_opcode_supported(probe, IORING_OP_OPENAT)
+        && io_uring_opcode_supported(probe, IORING_OP_READ)
+        && io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+    if (probe) {
+        io_uring_free_probe(probe);
+    }
+    if (!supported) {
+        io_uring_queue_exit(&ring);
+        return false;
+    }
+
+    struct Job {
+        int         dir_fd;
+        std::size_t dir;
+        std::string name;
+    };
+    std::vector<Job> jobs;
+    std::vector<DIR*> opened;
+    for (std::size_t d = 0; d < dirs.size(); d++) {
+        auto dir = opendir(dirs[d].c_str());
+        if (!dir) {
+            continue;
+        }
+        opened.push_back(dir);
+        auto dir_fd = dirfd(dir);
+        while (auto dirent = readdir(dir)) {
+            auto type = dirent->d_type;
+            if (type == DT_LNK || type == DT_UNKNOWN) {
+                struct stat st;
+                type = fstatat(dir_fd, dirent->d_name, &st, 0) == 0 && S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type != DT_REG) {
+                continue;
+            }
+            // listing order decides which file wins, the entries are put in that order at the end
+            if (table.add_id(dirent->d_name)) {
+                jobs.push_back({ dir_fd, d, dirent->d_name });
+            }
+        }
+    }
+
+    auto buffers = std::make_unique<char[]>(SLOTS * BUFFER_SIZE);
+    std::array<std::size_t, SLOTS> slot_job;
+    std::array<int, SLOTS> slot_fd;
+    std::size_t next_job = 0;
+    std::size_t in_flight = 0;
+    // files complete out of order, the job of each entry appended from `first` on
+    auto first = table.size();
+    std::vector<std::size_t> entry_jobs;
+
+    auto submit = [&ring](auto&& prep, std::size_t slot, Op op) {
+        auto sqe = io_uring_get_sqe(&ring);
+        if (!sqe) {
+            io_uring_submit(&ring);
+            sqe = io_uring_get_sqe(&ring);
+        }
+        prep(sqe);
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(slot << 2 | op));
+    };
+    auto start_next = [&](std::size_t slot) {
+        if (next_job == jobs.size()) {
+            return;
+        }
+        slot_job[slot] = next_job;
+        auto& job = jobs[next_job++];
+        submit([&job](auto sqe) {
+            io_uring_prep_openat(sqe, job.dir_fd, job.name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        }, slot, Open);
+        in_flight++;
+    };
+    for (std::size_t slot = 0; slot < SLOTS; slot++) {
+        start_next(slot);
+    }
+    while (in_flight > 0) {
+        io_uring_submit_and_wait(&ring, 1);
+        io_uring_cqe* cqe;
+        while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+            auto data = reinterpret_cast<std::uintptr_t>(io_uring_cqe_get_data(cqe));
+            auto res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            auto slot = data >> 2;
+            auto op = static_cast<Op>(data & 3);
+            auto buffer = buffers.get() + slot * BUFFER_SIZE;
+            in_flight--;
+            if (op == Open) {
+                if (res < 0) {
+                    start_next(slot);
+                    continue;
+                }
+                slot_fd[slot] = res;
+                submit([buffer, fd = res](auto sqe) {
+                    io_uring_prep_read(sqe, fd, buffer, BUFFER_SIZE, 0);
+                }, slot, Read);
+                in_flight++;
+            } else if (op == Read) {
+                auto& job = jobs[slot_job[slot]];
+                submit([fd = slot_fd[slot]](auto sqe) {
+                    io_uring_prep_close(sqe, fd);
+                }, slot, Close);
+                in_flight++;
+                // the buffer is only read into once the next file is open
+                start_next(slot);
+                // the close, the next open and the reads queued so far run while the file is parsed
+                io_uring_submit(&ring);
+                // entries are views into the buffer, copy them out before it is reused
+                std::optional<DesktopEntry> entry;
+                if (res == static_cast<int>(BUFFER_SIZE)) {
+                    // too big for the buffer, rare enough to read it the usual way
+                    entry = desktop_entry(dirs[job.dir] + '/' + job.name, lang);
+                } else if (res >= 0) {
+                    entry = parse_desktop_entry({ buffer, static_cast<std::size_t>(res) }, lang);
+                }
+                if (entry) {
+                    table.set_entry(job.name, *entry);
+                    entry_jobs.push_back(slot_job[slot]);
+                }
+            }
+        }
+    }
+    // same indices as the synchronous scan
+    table.sort_from(first, entry_jobs);
+    io_uring_queue_exit(&ring);
+    for (auto dir : opened) {
+        closedir(dir);
+    }
+    return true;
+}
+#endif
+
+/*
+ * Parses .desktop files found in `dirs` into `table`, the first file with a given desktop-id wins
+ * */
+void load_desktop_entries(const std::vector<std::string>& dirs, const std::string& lang, EntryTable& table) {
+#ifdef HAVE_IO_URING
+    if (load_desktop_entries_uring(dirs, lang, table)) {
+        return;
+    }
+#endif
+    auto desktop_id = [](auto& path) {
+        return path.string(); // actual desktop_id requires '/' to be replaced with '-'
+    };
+
+    for (auto& dir : dirs) {
+        std::error_code ec;
+        auto dir_iter = fs::directory_iterator(dir, ec);
+        for (auto& entry : dir_iter) {
+            if (ec) {
+                std::cerr << ec.message() << '\n';
+                ec.clear();
+                continue;
+            }
+            if (!entry.is_regular_file()) {
+                continue;
+            }
+            auto& path = entry.path();
+            auto&& rel_path = path.lexically_relative(dir);
+            auto&& id = desktop_id(rel_path);
+            if (table.add_id(id)) {
+                if (auto entry = desktop_entry(path, lang)) {
+                    table.set_entry(id, *entry);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Returns the file caching the entries of `dir`, e.g. `nwg-dirs-cache/%usr%share%applications`
+ * */
+static fs::path dir_cache_file(std::string dir) {
+    std::replace(dir.begin(), dir.end(), '/', '%');
+    return get_cache_home() / "nwg-dirs-cache" / dir;
+}
+
+/*
+ * Serializes `scan` as {desktop-id: entry or null for hidden}; exec is stored without the terminal prefix
+ * */
+static ns::json dir_entries_to_json(const EntryTable& scan) {
+    auto json = ns::json::object();
+    scan.for_each_hidden([&json](std::string_view id) {
+        json[std::string{ id }] = nullptr;
+    });
+    for (std::size_t i = 0; i < scan.size(); i++) {
+        auto entry = scan.view(i);
+        if (entry.terminal) {
+            entry.exec.remove_prefix(std::min(entry.exec.size(), scan.terminal_prefix().size() + 1));
+        }
+        json[std::string{ scan.get(scan[i].desktop_id) }] = {
+            { "name", entry.name },
+            { "exec", entry.exec },
+            { "icon", entry.icon },
+            { "comment", entry.comment },
+            { "mime_type", entry.mime_type },
+            { "wm_class", entry.wm_class },
+            { "terminal", entry.terminal }
+        };
+    }
+    return json;
+}
+
+/*
+ * Reads the entries of `dir` saved by the last complete scan, empty if there are none
+ * */
+static EntryTable load_dir_cache(const std::string& dir, const std::string& term) {
+    EntryTable scan{ term };
+    try {
+        auto json = json_from_file(dir_cache_file(dir));
+        for (auto& [id, value] : json.items()) {
+            if (value.is_null()) {
+                scan.add(id, std::nullopt);
+                continue;
+            }
+            auto& name = value.at("name").get_ref<const std::string&>();
+            auto& exec = value.at("exec").get_ref<const std::string&>();
+            auto& icon = value.at("icon").get_ref<const std::string&>();
+            auto& comment = value.at("comment").get_ref<const std::string&>();
+            auto& mime_type = value.at("mime_type").get_ref<const std::string&>();
+            auto& wm_class = value.at("wm_class").get_ref<const std::string&>();
+            scan.add(id, DesktopEntry{ name, exec, icon, comment, mime_type, wm_class, value.at("terminal").get<bool>() });
+        }
+    } catch (...) {
+        std::cerr << "ERROR: No usable cache for '" << dir << "'\n";
+    }
+    return scan;
+}
+
+/*
+ * Saves the results of a complete scan of `dir` if they differ from the cached ones
+ * */
+static void save_dir_cache(const std::string& dir, const ns::json& json) {
+    auto file = dir_cache_file(dir);
+    auto contents = json.dump();
+    std::error_code ec;
+    if (fs::exists(file, ec) && read_file_to_string(file) == contents) {
+        return;
+    }
+    fs::create_directories(file.parent_path(), ec);
+    auto tmp = file;
+    tmp += ".tmp";
+    save_string_to_file(contents, tmp);
+    fs::rename(tmp, file, ec);
+}
+
+/*
+ * Notes the files of a scan of `dir` for the readahead, in the main thread:
+ * the scan threads may outlive the statics it records to
+ * */
+static void note_dir_files(const std::string& dir, const EntryTable& scan) {
+    scan.for_each_hidden([&dir](std::string_view id) {
+        StartupReadahead::note(dir + '/' + std::string{ id });
+    });
+    for (std::size_t i = 0; i < scan.size(); i++) {
+        StartupReadahead::note(dir + '/' + std::string{ scan.get(scan[i].desktop_id) });
+    }
+}
+
+struct DirScanner::State {
+    std::mutex                             mutex;
+    std::condition_variable                scanned;
+    std::vector<std::optional<EntryTable>> results;
+    std::vector<bool>                      late;       // replaced by cached entries
+    std::vector<bool>                      done;       // the thread is about to return
+    bool                                   stopped;    // the scanner is gone, results are dropped
+    Glib::Dispatcher*                      dispatcher; // null until on_late, and after the scanner is gone
+};
+
+DirScanner::DirScanner(std::vector<std::string> dirs_, const std::string& lang, const std::string& term_)
+ : dirs(std::move(dirs_)), term(term_), state(std::make_shared<State>())
+{
+    state->results.resize(dirs.size());
+    state->late.resize(dirs.size(), false);
+    state->done.resize(dirs.size(), false);
+    state->stopped = false;
+    state->dispatcher = nullptr;
+    for (std::size_t i = 0; i < dirs.size(); i++) {
+        // owns copies of everything it uses besides `state`, see ~DirScanner
+        threads.emplace_back([state = state, dir = dirs[i], lang, term = term, i]() {
+            EntryTable scan{ term };
+            load_desktop_entries({ dir }, lang, scan);
+            std::unique_lock lock{ state->mutex };
+            if (!state->stopped) {
+                // a copy is posted, serializing and saving the cache happen past the budget
+                state->results[i] = scan;
+                if (state->late[i] && state->dispatcher) {
+                    state->dispatcher->emit();
+                }
+                lock.unlock();
+                state->scanned.notify_all();
+                save_dir_cache(dir, dir_entries_to_json(scan));
+                lock.lock();
+            }
+            state->done[i] = true;
+            lock.unlock();
+            state->scanned.notify_all();
+        });
+    }
+}
+
+/*
+ * Joins the scans finished within the budget. A thread stuck on a dead mount must not
+ * block exit, so the rest are detached: once stopped they touch nothing but `state`
+ * */
+DirScanner::~DirScanner() {
+    std::vector<bool> done;
+    {
+        std::unique_lock lock{ state->mutex };
+        state->stopped = true;
+        state->dispatcher = nullptr;
+        auto& done_ = state->done;
+        state->scanned.wait_for(lock, budget, [&done_]() {
+            return std::all_of(done_.begin(), done_.end(), [](bool d) { return d; });
+        });
+        done = done_;
+    }
+    for (std::size_t i = 0; i < threads.size(); i++) {
+        if (done[i]) {
+            threads[i].join();
+        } else {
+            threads[i].detach();
+        }
+    }
+}
+
+std::vector<EntryTable> DirScanner::wait_for(std::chrono::milliseconds budget_) {
+    budget = budget_;
+    std::vector<EntryTable> result(dirs.size());
+    std::vector<bool> late(dirs.size(), false);
+    {
+        std::unique_lock lock{ state->mutex };
+        auto& results = state->results;
+        state->scanned.wait_for(lock, budget, [&results]() {
+            return std::all_of(results.begin(), results.end(), [](auto& r) { return r.has_value(); });
+        });
+        for (std::size_t i = 0; i < dirs.size(); i++) {
+            if (results[i]) {
+                result[i] = std::move(*results[i]);
+                results[i].reset();
+            } else {
+                state->late[i] = true;
+                late[i] = true;
+            }
+        }
+    }
+    for (std::size_t i = 0; i < dirs.size(); i++) {
+        if (!late[i]) {
+            note_dir_files(dirs[i], result[i]);
+            continue;
+        }
+        std::cerr << "WARNING: '" << dirs[i] << "' took longer than " << budget.count() << "ms, using cached entries\n";
+        result[i] = load_dir_cache(dirs[i], term);
+    }
+    return result;
+}
+
+void DirScanner::on_late(std::function<void(std::size_t, EntryTable&&)> callback_) {
+    callback = std::move(callback_);
+    dispatcher = std::make_unique<Glib::Dispatcher>();
+    dispatcher->connect(sigc::mem_fun(*this, &DirScanner::deliver_late));
+    std::lock_guard lock{ state->mutex };
+    state->dispatcher = dispatcher.get();
+    // some may have finished already
+    dispatcher->emit();
+}
+
+void DirScanner::deliver_late() {
+    std::vector<std::pair<std::size_t, EntryTable>> scans;
+    {
+        std::lock_guard lock{ state->mutex };
+        for (std::size_t i = 0; i < dirs.size(); i++) {
+            if (state->late[i] && state->results[i]) {
+                std::cout << "Late entries of '" << dirs[i] << "' loaded\n";
+                state->late[i] = false;
+                scans.emplace_back(i, std::move(*state->results[i]));
+                state->results[i].reset();
+            }
+        }
+    }
+    for (auto& [i, scan] : scans) {
+        note_dir_files(dirs[i], scan);
+        callback(i, std::move(scan));
     }
-    return entry;
 }
 
 /*
@@ -184,6 +872,7 @@ std::optional<DesktopEntry> desktop_entry(std::string&& path, const std::string&
  * */
 std::vector<std::string> get_pinned(const std::filesystem::path& pinned_file) {
     std::vector<std::string> lines;
+    StartupReadahead::note(pinned_file);
     std::ifstream in(pinned_file);
     if(!in) {
         std::cerr << "Could not find " << pinned_file << ", creating!" << std::endl;
@@ -219,3 +908,94 @@ std::vector<CacheEntry> get_favourites(ns::json&& cache, int number) {
     sorted_cache.erase(from, to);
     return sorted_cache;
 }
+
+/*
+ * Writes `str` as a TSV field, escaping backslashes, tabs and newlines
+ * */
+static void write_tsv_field(std::ostream& out, std::string_view str) {
+    for (auto c : str) {
+        switch (c) {
+            case '\\': out << "\\\\"; break;
+            case '\t': out << "\\t"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            default:   out << c;
+        }
+    }
+}
+
+/*
+ * Writes the shown entries in the order of the grids: pinned ones by position,
+ * favourites by clicks, then the rest by name in the collation of the locale,
+ * each with ties by desktop id; exec is the command as it is run
+ * */
+void dump_catalog(std::ostream& out, const EntryTable& table, const std::vector<Stats>& stats, DumpFormat format) {
+    enum Section { Pinned, Favourite, App };
+    constexpr std::array section_names { "pinned", "favourite", "app" };
+    auto section_of = [&stats](std::size_t i) {
+        return stats[i].pinned ? Pinned : stats[i].favorite ? Favourite : App;
+    };
+    std::vector<std::size_t> order(table.size());
+    for (std::size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+        auto section_a = section_of(a);
+        auto section_b = section_of(b);
+        if (section_a != section_b) {
+            return section_a < section_b;
+        }
+        switch (section_a) {
+            case Pinned:
+                if (stats[a].position != stats[b].position) {
+                    return stats[a].position < stats[b].position;
+                }
+                break;
+            case Favourite:
+                if (stats[a].clicks != stats[b].clicks) {
+                    return stats[a].clicks > stats[b].clicks;
+                }
+                break;
+            default:
+                // pool strings are NUL-terminated
+                if (auto c = g_utf8_collate(table.get(table[a].name).data(), table.get(table[b].name).data())) {
+                    return c < 0;
+                }
+        }
+        // ties go by desktop id, so the dump does not depend on the scan order
+        return table.get(table[a].desktop_id) < table.get(table[b].desktop_id);
+    });
+
+    if (format == DumpFormat::Json) {
+        auto json = ns::json::array();
+        for (auto i : order) {
+            auto entry = table.view(i);
+            json.push_back({
+                { "section", section_names[section_of(i)] },
+                { "desktop_id", table.get(table[i].desktop_id) },
+                { "name", entry.name },
+                { "exec", entry.exec },
+                { "icon", entry.icon },
+                { "comment", entry.comment },
+                { "mime_type", entry.mime_type },
+                { "wm_class", entry.wm_class },
+                { "terminal", entry.terminal },
+                { "clicks", stats[i].clicks }
+            });
+        }
+        // .desktop files are not always valid UTF-8
+        out << json.dump(2, ' ', false, ns::json::error_handler_t::replace) << '\n';
+        return;
+    }
+    out << "section\tdesktop_id\tname\texec\ticon\tcomment\tmime_type\twm_class\tterminal\tclicks\n";
+    for (auto i : order) {
+        auto entry = table.view(i);
+        out << section_names[section_of(i)];
+        for (auto field : { table.get(table[i].desktop_id), entry.name, entry.exec, entry.icon,
+                            entry.comment, entry.mime_type, entry.wm_class }) {
+            out << '\t';
+            write_tsv_field(out, field);
+        }
+        out << '\t' << (entry.terminal ? "true" : "false") << '\t' << stats[i].clicks << '\n';
+    }
+}